@@ -6,6 +6,12 @@
 #include <functional>
 #include <unordered_set>
 #include <chrono>
+#include <memory>
+#include <utility>
+#include <cmath>
+#include <algorithm>
+
+#include "history.h"
 
 namespace astar {
 
@@ -26,24 +32,32 @@ struct MoveTypeRef<true, M> {
 template <class T>
 class SearchNode {
 public:
-    typedef decltype(((T*)nullptr)->getLastMove()) MoveType;
+    typedef decltype(std::declval<const T&>().getLastMove()) MoveType;
 
 private:
     typedef MoveTypeRef<(sizeof(MoveType) > sizeof(MoveType*)), MoveType> MoveTypeRefImpl;
     const T* state;
+    /* set when the history does not retain states, so the node has to keep the state alive itself; a queued
+     * node whose history can rebuild its state has neither this nor `state`, only `historyIndex` */
+    std::shared_ptr<const T> ownedState;
+    size_t historyIndex;
     unsigned pathCost;
     unsigned heuristic;
     mutable std::vector<T> cachedSuccessors;
     MoveTypeRefImpl initialMove;
 public:
-    SearchNode() : state(nullptr), pathCost(0), heuristic(0), initialMove(nullptr) {}
-    SearchNode(const T& state, unsigned pathCost, unsigned heuristic, const MoveType* initialMove = nullptr) : state(&state), pathCost(pathCost), heuristic(heuristic), initialMove(initialMove) {}
-    SearchNode(const SearchNode<T>& copy) : state(copy.state), pathCost(copy.pathCost), heuristic(copy.heuristic), cachedSuccessors(copy.cachedSuccessors), initialMove(copy.initialMove) {}
-    SearchNode(SearchNode<T>&& move) : state(move.state), pathCost(move.pathCost), heuristic(move.heuristic), cachedSuccessors(std::move(move.cachedSuccessors)), initialMove(std::move(move.initialMove)) {}
+    SearchNode() : state(nullptr), historyIndex(NO_PARENT), pathCost(0), heuristic(0), initialMove(nullptr) {}
+    SearchNode(const T& state, unsigned pathCost, unsigned heuristic, const MoveType* initialMove = nullptr, size_t historyIndex = NO_PARENT) : state(&state), historyIndex(historyIndex), pathCost(pathCost), heuristic(heuristic), initialMove(initialMove) {}
+    SearchNode(size_t historyIndex, unsigned pathCost, unsigned heuristic, const MoveType* initialMove = nullptr) : state(nullptr), historyIndex(historyIndex), pathCost(pathCost), heuristic(heuristic), initialMove(initialMove) {}
+    SearchNode(std::shared_ptr<const T> ownedState, unsigned pathCost, unsigned heuristic, const MoveType* initialMove = nullptr, size_t historyIndex = NO_PARENT) : state(ownedState.get()), ownedState(std::move(ownedState)), historyIndex(historyIndex), pathCost(pathCost), heuristic(heuristic), initialMove(initialMove) {}
+    SearchNode(const SearchNode<T>& copy) : state(copy.state), ownedState(copy.ownedState), historyIndex(copy.historyIndex), pathCost(copy.pathCost), heuristic(copy.heuristic), cachedSuccessors(copy.cachedSuccessors), initialMove(copy.initialMove) {}
+    SearchNode(SearchNode<T>&& move) : state(move.state), ownedState(std::move(move.ownedState)), historyIndex(move.historyIndex), pathCost(move.pathCost), heuristic(move.heuristic), cachedSuccessors(std::move(move.cachedSuccessors)), initialMove(std::move(move.initialMove)) {}
     ~SearchNode() {}
 
     SearchNode& operator=(const SearchNode<T>& copy) {
         state = copy.state;
+        ownedState = copy.ownedState;
+        historyIndex = copy.historyIndex;
         pathCost = copy.pathCost;
         heuristic = copy.heuristic;
         cachedSuccessors = copy.cachedSuccessors;
@@ -52,6 +66,8 @@ public:
     }
     SearchNode& operator=(SearchNode<T>&& move) {
         state = move.state;
+        ownedState = std::move(move.ownedState);
+        historyIndex = move.historyIndex;
         pathCost = move.pathCost;
         heuristic = move.heuristic;
         cachedSuccessors = std::move(move.cachedSuccessors);
@@ -66,6 +82,7 @@ public:
     }
 
     inline const T& getState() const { return *state; }
+    inline size_t getHistoryIndex() const { return historyIndex; }
     inline unsigned getPathCost() const { return pathCost; }
     inline unsigned getHeuristic() const { return heuristic; }
     inline unsigned getFCost() const { return getPathCost() + getHeuristic(); }
@@ -82,31 +99,41 @@ inline bool nodeComparator(const SearchNode<T>& lhs, const SearchNode<T>& rhs) {
     return lhs.getFCost() < rhs.getFCost();
 }
 
-template <class T, class H>
+template <class T, class H, class History = ExactHistory<T>>
 class AStar {
 private:
     typedef std::priority_queue<SearchNode<T>, std::vector<SearchNode<T>>, std::function<bool(const SearchNode<T>&,const SearchNode<T>&)>> QueueType;
     QueueType queue;
     H heuristic;
-    std::unordered_set<T> history;
+    History history;
     size_t nodesExpanded;
     unsigned depthLimit;
 public:
-    typedef decltype(((T*)nullptr)->getLastMove()) MoveType;
+    typedef decltype(std::declval<const T&>().getLastMove()) MoveType;
 private:
     std::vector<MoveType> initialMoves;
-public:
-    AStar(const T& initialState, const H& heuristic, unsigned depthLimit = 0) : queue(&nodeComparator<T>), heuristic(heuristic), nodesExpanded(0), depthLimit(depthLimit) {
-        const T& h = *history.insert(initialState).first;
-        queue.emplace(h, 0, heuristic(initialState));
+    typedef HistoryRebuilder<T, History> Rebuilder;
+    void enqueue(const T& state, const HistoryEntry<T>& entry, unsigned pathCost, const MoveType* initialMove) {
+        if(entry.state) {
+            queue.emplace(*entry.state, pathCost, heuristic(state), initialMove, entry.index);
+        } else if(Rebuilder::CAN_REBUILD && pathCost > 0) {
+            /* (the root keeps a copy, so that isDone() can look at it before anything is expanded) */
+            queue.emplace(entry.index, pathCost, heuristic(state), initialMove);
+        } else {
+            queue.emplace(std::make_shared<const T>(state), pathCost, heuristic(state), initialMove, entry.index);
+        }
     }
-    AStar(T&& initialState, const H& heuristic, unsigned depthLimit = 0) : queue(&nodeComparator<T>), heuristic(heuristic), nodesExpanded(0), depthLimit(depthLimit) {
-        const T& h = *history.insert(initialState).first;
-        queue.emplace(h, 0, heuristic(initialState));
+public:
+    AStar(const T& initialState, const H& heuristic, unsigned depthLimit = 0, History&& history = History()) : queue(&nodeComparator<T>), heuristic(heuristic), history(std::move(history)), nodesExpanded(0), depthLimit(depthLimit) {
+        enqueue(initialState, this->history.insert(initialState), 0, nullptr);
     }
+    /* adds states that have already been visited (e.g., earlier positions of the game) to the history */
     void setHistory(const std::unordered_set<T>& existingHistory) {
-        history = existingHistory;
+        for(const T& state : existingHistory) {
+            history.insert(state);
+        }
     }
+    inline const History& getHistory() const { return history; }
     const SearchNode<T>& top() const {
         return queue.top();
     }
@@ -122,14 +149,17 @@ public:
         SearchNode<T> next = queue.top();
         bool isFirstExpansion = nodesExpanded++ == 0;
         queue.pop();
+        if(!next) {
+            next = SearchNode<T>(std::make_shared<const T>(Rebuilder::rebuild(history, next.getHistoryIndex())), next.getPathCost(), next.getHeuristic(), next.getInitialMove(), next.getHistoryIndex());
+        }
         if(isFirstExpansion || depthLimit == 0 || next.getPathCost() < depthLimit) {
             for(const T& successor : next.getSuccessors()) {
-                if(history.find(successor) == history.end()) {
-                    const T& h = *history.insert(successor).first;
+                HistoryEntry<T> entry = history.insert(successor, next.getHistoryIndex());
+                if(entry.inserted) {
                     if(isFirstExpansion) {
-                        initialMoves.push_back(h.getLastMove());
+                        initialMoves.push_back(successor.getLastMove());
                     }
-                    queue.emplace(h, next.getPathCost() + 1, heuristic(successor), isFirstExpansion ? &initialMoves.back() : next.getInitialMove());
+                    enqueue(successor, entry, next.getPathCost() + 1, isFirstExpansion ? &initialMoves.back() : next.getInitialMove());
                 }
             }
         }
@@ -158,44 +188,99 @@ public:
     }
 };
 
-template <class T, class H>
+template <class T, class H, class History = ExactHistory<T>>
 class IDAStar {
     const T& initialState;
     H heuristic;
     const std::unordered_set<T>& history;
+    /* the depth limit and number of nodes expanded of every iteration that ran to the end */
+    std::vector<std::pair<unsigned, size_t>> iterations;
+    double estimatedNodes;
+    double giveUpFactor;
+    bool gaveUp;
+    /* the projected size of the iteration with the given depth limit: the last full iteration's size times the
+     * branching factor once for every level deeper, or zero (no estimate) until there are two to extrapolate from */
+    double estimateNodes(unsigned depth) const {
+        const double branchingFactor = getBranchingFactor();
+        if(branchingFactor > 0) {
+            return iterations.back().second * std::pow(branchingFactor, static_cast<double>(depth - iterations.back().first));
+        }
+        return 0.0;
+    }
 public:
-    IDAStar(const T& initialState, H heuristic, const std::unordered_set<T>& history) : initialState(initialState), heuristic(heuristic), history(history) {}
+    IDAStar(const T& initialState, H heuristic, const std::unordered_set<T>& history) : initialState(initialState), heuristic(heuristic), history(history), estimatedNodes(0.0), giveUpFactor(0.0), gaveUp(false) {}
+    /* whether there is nothing to search: the same test as AStar::isDone() on a new search, without making one */
     bool isDone() const {
-        return AStar<T,H>(initialState, heuristic, 0).isDone();
+        return initialState.successors().empty();
+    }
+    /* Gives up on an iteration, keeping the result of the last one to finish, as soon as at the rate nodes have
+     * been expanded so far it is projected to need more than `factor` times the time that is left: it would
+     * probably run out of time before finishing, and an unfinished iteration's result is thrown away.  Zero
+     * (the default) never gives up. */
+    inline void setGiveUpFactor(double factor) { giveUpFactor = factor; }
+    /* whether the last solve() gave up early instead of running out of time or finishing */
+    inline bool hasGivenUp() const { return gaveUp; }
+    /* the ratio of the sizes of the last two full iterations, or zero if fewer than two have finished */
+    inline double getBranchingFactor() const {
+        if(iterations.size() < 2) {
+            return 0.0;
+        }
+        const std::pair<unsigned, size_t>& last = iterations[iterations.size() - 1];
+        const std::pair<unsigned, size_t>& previous = iterations[iterations.size() - 2];
+        return std::max(std::pow(static_cast<double>(last.second) / std::max<size_t>(previous.second, 1), 1.0 / (last.first - previous.first)), 1.0);
+    }
+    /* the projected number of nodes the current iteration has left to expand, given the search it is running, or
+     * zero until two iterations have finished */
+    inline double getEstimatedRemaining(const AStar<T,H,History>& as) const {
+        return std::max(estimatedNodes - as.getNodesExpanded(), 0.0);
     }
-    SearchNode<T> solve(std::chrono::milliseconds timeLimit, unsigned initialDepth = 1, const std::function<bool(const SearchNode<T>&, const AStar<T,H>&, unsigned)>& callback = [](const SearchNode<T>&) { return true; }) {
+    SearchNode<T> solve(std::chrono::milliseconds timeLimit, unsigned initialDepth = 1, const std::function<bool(const SearchNode<T>&, const AStar<T,H,History>&, unsigned)>& callback = [](const SearchNode<T>&) { return true; }) {
         auto startTime = std::chrono::system_clock::now().time_since_epoch();
         SearchNode<T> bestResult;
+        /* the nodes expanded by the iterations so far, to measure the rate */
+        size_t totalNodes = 0;
+        /* each iteration's history is made for eight times the states the last one inserted (more than the
+         * branching factor between iterations usually is), but for no more than a BloomHistory's default */
+        size_t expectedStates = history.size() + (1 << 12);
+        iterations.clear();
+        gaveUp = false;
         if(initialDepth < 1) {
             initialDepth = 1;
         }
         for(unsigned depth=initialDepth;; ++depth) {
-            AStar<T,H> as(initialState, heuristic, depth);
+            AStar<T,H,History> as(initialState, heuristic, depth, HistoryFactory<History>::make(std::min<size_t>(expectedStates, 1 << 20)));
             if(as.isDone()) {
                 break;
             }
             as.setHistory(history);
-            if(SearchNode<T> newBest = as.solve([&callback,startTime,timeLimit,&as,depth](const SearchNode<T>& node)->bool{
+            estimatedNodes = estimateNodes(depth);
+            const bool canGiveUp = giveUpFactor > 0 && bestResult;
+            if(SearchNode<T> newBest = as.solve([this,&callback,&as,startTime,timeLimit,depth,totalNodes,canGiveUp](const SearchNode<T>& node)->bool{
                         auto timeElapsed = std::chrono::system_clock::now().time_since_epoch() - startTime;
                         if(timeElapsed >= timeLimit) {
                             return false;
-                        } else {
-                            return callback(node, as, depth);
+                        } else if(canGiveUp) {
+                            const double seconds = std::chrono::duration<double>(timeElapsed).count();
+                            const double secondsLeft = std::chrono::duration<double>(timeLimit - timeElapsed).count();
+                            const double nodesPerSecond = (totalNodes + as.getNodesExpanded()) / std::max(seconds, 1e-9);
+                            if(getEstimatedRemaining(as) > giveUpFactor * secondsLeft * nodesPerSecond) {
+                                gaveUp = true;
+                                return false;
+                            }
                         }
+                        return callback(node, as, depth);
                     })) {
                 bestResult = newBest;
+                iterations.emplace_back(depth, as.getNodesExpanded());
+                totalNodes += as.getNodesExpanded();
+                expectedStates = history.size() + 8 * as.getHistory().size();
             } else {
                 break;
             }
         }
         return bestResult;
     }
-    inline SearchNode<T> solve(unsigned timeLimit, unsigned initialDepth = 1, const std::function<bool(const SearchNode<T>&, const AStar<T,H>&, unsigned)>& callback = [](const SearchNode<T>&) { return true; }) {
+    inline SearchNode<T> solve(unsigned timeLimit, unsigned initialDepth = 1, const std::function<bool(const SearchNode<T>&, const AStar<T,H,History>&, unsigned)>& callback = [](const SearchNode<T>&) { return true; }) {
         return solve(std::chrono::milliseconds(timeLimit), initialDepth, callback);
     }
 };
@@ -0,0 +1,466 @@
+#ifndef ASTAR_DISTRIBUTED
+#define ASTAR_DISTRIBUTED
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <queue>
+#include <string>
+#include <chrono>
+#include <stdexcept>
+#include <functional>
+#include <utility>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "history.h"
+
+namespace astar {
+
+struct Peer {
+    std::string host;
+    uint16_t port;
+};
+
+/* Best-first search spread over several processes, each of which may be on a different machine.  Every state
+ * belongs to exactly one process, chosen by its hash, which keeps the only copy of the closed list for its
+ * states.  A process expands its own states best first, a round of up to ROUND_SIZE at a time, and sends the
+ * children it does not own to their owners in batches of up to BATCH_SIZE, as the states' encode()d bytes
+ * plus the path cost and the first move of the path, so no process ever needs another's memory.  Whatever
+ * is left of every batch is sent at the end of each round, so a state reaches its owner at most a round
+ * after it was made.  Processes never wait for each other, so the search as a whole is best first only to
+ * within that lag, and the path to a win it finds need not be a shortest one.  Like AStar::solve(), the search
+ * only reports the first move of that path (and its length), which is all a game loop needs.
+ *
+ * The processes form a full mesh of TCP connections.  The search is over when some process reaches a win or
+ * when every process is idle with no batch in flight; the latter is detected with Safra's token algorithm:
+ * each process counts the batches it has sent minus those it has received and turns black when it receives
+ * one; a token passed around the ring sums the counts and picks up black, and process 0 declares the search
+ * exhausted when a token comes back white with a sum of zero to find process 0 itself idle and white.
+ *
+ * T needs ENCODED_SIZE, encode(uint8_t*), a static decode(const uint8_t*), successors(), isWin(), pack() (for
+ * the closed list), and a std::hash that is the same in every process. */
+template <class T, class H>
+class DistributedSearch {
+public:
+    typedef decltype(std::declval<const T&>().getLastMove()) MoveType;
+    static constexpr size_t BATCH_SIZE = 256;
+    static constexpr size_t ROUND_SIZE = 64;
+    struct Result {
+        bool solved;
+        bool exhausted;
+        /* MoveType::pack() of the first move of the path to the win, and the length of that path */
+        uint16_t initialMove;
+        unsigned pathLength;
+        /* what this process did */
+        size_t statesExpanded;
+        size_t batchesSent;
+    };
+private:
+    enum MessageType : uint32_t {
+        STATES = 1,
+        TOKEN = 2,
+        SOLUTION = 3,
+        STOP = 4
+    };
+    /* for STATES, `count` records follow; for TOKEN, `a` is the count and `b` the color; for SOLUTION, `a` is
+     * the initial move and `b` the path length */
+    struct MessageHeader {
+        uint32_t type;
+        uint32_t count;
+        int32_t a;
+        uint32_t b;
+    };
+    static constexpr size_t RECORD_SIZE = T::ENCODED_SIZE + 2 * sizeof(uint16_t);
+    struct Connection {
+        int fd;
+        std::vector<uint8_t> in;
+        std::vector<uint8_t> out;
+        size_t outOffset;
+        /* the records of the batch being collected for this peer */
+        std::vector<uint8_t> batch;
+        size_t batchCount;
+        Connection() : fd(-1), outOffset(0), batchCount(0) {}
+    };
+    struct Node {
+        T state;
+        unsigned fCost;
+        uint16_t pathCost;
+        uint16_t initialMove;
+        Node(const T& state, unsigned fCost, uint16_t pathCost, uint16_t initialMove) : state(state), fCost(fCost), pathCost(pathCost), initialMove(initialMove) {}
+        /* lowest F-cost first, then deepest */
+        inline bool operator<(const Node& other) const {
+            return fCost != other.fCost ? fCost > other.fCost : pathCost < other.pathCost;
+        }
+    };
+    std::vector<Peer> peers;
+    size_t rank;
+    H heuristic;
+    std::vector<Connection> connections;
+    std::priority_queue<Node> open;
+    PackedHistory<T> closed;
+    Result result;
+    bool stopped;
+    /* Safra's algorithm */
+    int64_t messageCount;
+    bool black;
+    bool holdingToken;
+    bool tokenOut;
+    int64_t tokenCount;
+    bool tokenBlack;
+
+    static void setNonBlocking(int fd) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    static void writeFully(int fd, const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        while(size > 0) {
+            const ssize_t n = send(fd, bytes, size, MSG_NOSIGNAL);
+            if(n <= 0) {
+                throw std::runtime_error("Lost a connection to a peer during setup");
+            }
+            bytes += n;
+            size -= n;
+        }
+    }
+    static void readFully(int fd, void* data, size_t size) {
+        uint8_t* bytes = static_cast<uint8_t*>(data);
+        while(size > 0) {
+            const ssize_t n = recv(fd, bytes, size, 0);
+            if(n <= 0) {
+                throw std::runtime_error("Lost a connection to a peer during setup");
+            }
+            bytes += n;
+            size -= n;
+        }
+    }
+    static int connectTo(const Peer& peer, std::chrono::steady_clock::time_point deadline) {
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        for(;;) {
+            addrinfo* addresses = nullptr;
+            if(getaddrinfo(peer.host.c_str(), std::to_string(peer.port).c_str(), &hints, &addresses) == 0) {
+                for(addrinfo* address = addresses; address; address = address->ai_next) {
+                    const int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+                    if(fd >= 0 && connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+                        freeaddrinfo(addresses);
+                        return fd;
+                    } else if(fd >= 0) {
+                        close(fd);
+                    }
+                }
+                freeaddrinfo(addresses);
+            }
+            /* the peer may not be listening yet */
+            if(std::chrono::steady_clock::now() >= deadline) {
+                throw std::runtime_error("Unable to connect to " + peer.host + ":" + std::to_string(peer.port));
+            }
+            usleep(50000);
+        }
+    }
+    /* listens for the peers ranked above us and connects to the ones below, each announcing its rank */
+    void connectPeers(std::chrono::seconds timeout) {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        connections.resize(peers.size());
+        const int listener = socket(AF_INET6, SOCK_STREAM, 0);
+        int zero = 0;
+        int one = 1;
+        setsockopt(listener, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in6 address;
+        memset(&address, 0, sizeof(address));
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_any;
+        address.sin6_port = htons(peers[rank].port);
+        if(listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, static_cast<int>(peers.size())) != 0) {
+            throw std::runtime_error("Unable to listen on port " + std::to_string(peers[rank].port));
+        }
+        for(size_t other=0; other<rank; ++other) {
+            connections[other].fd = connectTo(peers[other], deadline);
+            const uint32_t me = rank;
+            writeFully(connections[other].fd, &me, sizeof(me));
+        }
+        for(size_t accepted=rank+1; accepted<peers.size(); ++accepted) {
+            pollfd waiting = { listener, POLLIN, 0 };
+            const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if(remaining <= 0 || poll(&waiting, 1, static_cast<int>(remaining)) <= 0) {
+                throw std::runtime_error("Timed out waiting for peers to connect");
+            }
+            const int fd = accept(listener, nullptr, nullptr);
+            uint32_t other = 0;
+            readFully(fd, &other, sizeof(other));
+            if(other <= rank || other >= peers.size() || connections[other].fd >= 0) {
+                throw std::runtime_error("A peer announced an unexpected rank");
+            }
+            connections[other].fd = fd;
+        }
+        close(listener);
+        for(size_t other=0; other<peers.size(); ++other) {
+            if(other != rank) {
+                setNonBlocking(connections[other].fd);
+            }
+        }
+    }
+    inline size_t owner(const T& state) const {
+        return mix64(std::hash<T>()(state)) % peers.size();
+    }
+    void sendMessage(size_t to, MessageType type, uint32_t count, int32_t a, uint32_t b, const uint8_t* payload = nullptr, size_t payloadSize = 0) {
+        const MessageHeader header = { type, count, a, b };
+        std::vector<uint8_t>& out = connections[to].out;
+        out.insert(out.end(), reinterpret_cast<const uint8_t*>(&header), reinterpret_cast<const uint8_t*>(&header) + sizeof(header));
+        out.insert(out.end(), payload, payload + payloadSize);
+    }
+    void broadcast(MessageType type, int32_t a = 0, uint32_t b = 0) {
+        for(size_t other=0; other<peers.size(); ++other) {
+            if(other != rank) {
+                sendMessage(other, type, 0, a, b);
+            }
+        }
+    }
+    void flushBatch(size_t to) {
+        Connection& connection = connections[to];
+        if(connection.batchCount > 0) {
+            sendMessage(to, STATES, connection.batchCount, 0, 0, connection.batch.data(), connection.batch.size());
+            connection.batch.clear();
+            connection.batchCount = 0;
+            ++messageCount;
+            ++result.batchesSent;
+        }
+    }
+    void flushBatches() {
+        for(size_t other=0; other<peers.size(); ++other) {
+            if(other != rank) {
+                flushBatch(other);
+            }
+        }
+    }
+    void add(const T& state, uint16_t pathCost, uint16_t initialMove) {
+        if(closed.insert(state).inserted) {
+            open.emplace(state, pathCost + heuristic(state), pathCost, initialMove);
+        }
+    }
+    void route(const T& state, uint16_t pathCost, uint16_t initialMove) {
+        const size_t to = owner(state);
+        if(to == rank) {
+            add(state, pathCost, initialMove);
+            return;
+        }
+        Connection& connection = connections[to];
+        const size_t offset = connection.batch.size();
+        connection.batch.resize(offset + RECORD_SIZE);
+        state.encode(&connection.batch[offset]);
+        memcpy(&connection.batch[offset + T::ENCODED_SIZE], &pathCost, sizeof(pathCost));
+        memcpy(&connection.batch[offset + T::ENCODED_SIZE + sizeof(pathCost)], &initialMove, sizeof(initialMove));
+        if(++connection.batchCount == BATCH_SIZE) {
+            flushBatch(to);
+        }
+    }
+    void solved(uint16_t initialMove, unsigned pathLength) {
+        if(!result.solved) {
+            result.solved = true;
+            result.initialMove = initialMove;
+            result.pathLength = pathLength;
+        }
+    }
+    void expand() {
+        const Node node = open.top();
+        open.pop();
+        ++result.statesExpanded;
+        if(node.state.isWin()) {
+            if(rank == 0) {
+                solved(node.initialMove, node.pathCost);
+                broadcast(STOP);
+                stopped = true;
+            } else {
+                sendMessage(0, SOLUTION, 0, node.initialMove, node.pathCost);
+            }
+            return;
+        }
+        for(const T& successor : node.state.successors()) {
+            route(successor, node.pathCost + 1, node.pathCost == 0 ? successor.getLastMove().pack() : node.initialMove);
+        }
+    }
+    void receive(size_t from) {
+        Connection& connection = connections[from];
+        size_t offset = 0;
+        while(!stopped && connection.in.size() - offset >= sizeof(MessageHeader)) {
+            MessageHeader header;
+            memcpy(&header, &connection.in[offset], sizeof(header));
+            const size_t payloadSize = header.type == STATES ? header.count * RECORD_SIZE : 0;
+            if(connection.in.size() - offset < sizeof(header) + payloadSize) {
+                break;
+            }
+            const uint8_t* payload = &connection.in[offset + sizeof(header)];
+            offset += sizeof(header) + payloadSize;
+            switch(header.type) {
+            case STATES:
+                --messageCount;
+                black = true;
+                for(size_t i=0; i<header.count; ++i, payload += RECORD_SIZE) {
+                    uint16_t pathCost;
+                    uint16_t initialMove;
+                    memcpy(&pathCost, payload + T::ENCODED_SIZE, sizeof(pathCost));
+                    memcpy(&initialMove, payload + T::ENCODED_SIZE + sizeof(pathCost), sizeof(initialMove));
+                    add(T::decode(payload), pathCost, initialMove);
+                }
+                break;
+            case TOKEN:
+                holdingToken = true;
+                tokenCount = header.a;
+                tokenBlack = header.b != 0;
+                break;
+            case SOLUTION:
+                solved(static_cast<uint16_t>(header.a), header.b);
+                broadcast(STOP);
+                stopped = true;
+                break;
+            case STOP:
+                stopped = true;
+                break;
+            default:
+                throw std::runtime_error("Received a malformed message");
+            }
+        }
+        connection.in.erase(connection.in.begin(), connection.in.begin() + offset);
+    }
+    /* waits up to `timeout` milliseconds for something to read, then reads and writes whatever it can */
+    void exchange(int timeout) {
+        std::vector<pollfd> fds;
+        std::vector<size_t> ranks;
+        for(size_t other=0; other<peers.size(); ++other) {
+            if(other != rank) {
+                const Connection& connection = connections[other];
+                fds.push_back({ connection.fd, static_cast<short>(POLLIN | (connection.out.size() > connection.outOffset ? POLLOUT : 0)), 0 });
+                ranks.push_back(other);
+            }
+        }
+        if(fds.empty() || poll(fds.data(), fds.size(), timeout) <= 0) {
+            return;
+        }
+        uint8_t buffer[1 << 16];
+        for(size_t i=0; i<fds.size(); ++i) {
+            Connection& connection = connections[ranks[i]];
+            if(fds[i].revents & POLLOUT) {
+                const ssize_t n = send(connection.fd, &connection.out[connection.outOffset], connection.out.size() - connection.outOffset, MSG_NOSIGNAL);
+                if(n > 0) {
+                    connection.outOffset += n;
+                    if(connection.outOffset == connection.out.size()) {
+                        connection.out.clear();
+                        connection.outOffset = 0;
+                    }
+                }
+            }
+            if(fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                const ssize_t n = recv(connection.fd, buffer, sizeof(buffer), 0);
+                if(n > 0) {
+                    connection.in.insert(connection.in.end(), buffer, buffer + n);
+                    receive(ranks[i]);
+                } else if(n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                    /* a peer that has gone away has either stopped or failed; either way, so do we */
+                    stopped = true;
+                }
+            }
+        }
+    }
+    void passToken(size_t to, int64_t count, bool isBlack) {
+        sendMessage(to, TOKEN, 0, static_cast<int32_t>(count), isBlack);
+        holdingToken = false;
+    }
+    /* the token rules of Safra's algorithm, for a process that has nothing left to do */
+    void idle() {
+        if(!holdingToken) {
+            return;
+        } else if(rank != 0) {
+            passToken((rank + 1) % peers.size(), tokenCount + messageCount, tokenBlack || black);
+            black = false;
+        } else if(tokenOut && !tokenBlack && !black && tokenCount + messageCount == 0) {
+            result.exhausted = true;
+            broadcast(STOP);
+            stopped = true;
+        } else if(peers.size() == 1) {
+            result.exhausted = messageCount == 0;
+            stopped = true;
+        } else {
+            black = false;
+            tokenOut = true;
+            passToken(1, 0, false);
+        }
+    }
+public:
+    /* `peers` lists every process, ours being peers[rank]; connecting waits up to `timeout` for the others */
+    DistributedSearch(const std::vector<Peer>& peers, size_t rank, H heuristic, std::chrono::seconds timeout = std::chrono::seconds(30)) : peers(peers), rank(rank), heuristic(heuristic), stopped(false), messageCount(0), black(false), holdingToken(rank == 0), tokenOut(false), tokenCount(0), tokenBlack(false) {
+        memset(&result, 0, sizeof(result));
+        if(peers.size() > 1) {
+            connectPeers(timeout);
+        }
+    }
+    ~DistributedSearch() {
+        for(Connection& connection : connections) {
+            if(connection.fd >= 0) {
+                close(connection.fd);
+            }
+        }
+    }
+    inline size_t getNumClosed() const { return closed.size(); }
+    /* Every process calls this with the same root.  Process 0 stops the search after `timeLimit` (if nonzero);
+     * `callback` is called about once a second with the result so far. */
+    Result solve(const T& root, std::chrono::seconds timeLimit = std::chrono::seconds(0), const std::function<void(const Result&)>& callback = [](const Result&) {}) {
+        const auto deadline = std::chrono::steady_clock::now() + timeLimit;
+        auto nextCallback = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        if(owner(root) == rank) {
+            add(root, 0, 0);
+        }
+        while(!stopped) {
+            exchange(open.empty() ? 10 : 0);
+            for(size_t i=0; i<ROUND_SIZE && !open.empty() && !stopped; ++i) {
+                expand();
+            }
+            if(stopped) {
+                break;
+            }
+            flushBatches();
+            if(open.empty()) {
+                idle();
+            }
+            const auto now = std::chrono::steady_clock::now();
+            if(now >= nextCallback) {
+                callback(result);
+                nextCallback = now + std::chrono::seconds(1);
+            }
+            if(rank == 0 && timeLimit.count() > 0 && now >= deadline) {
+                broadcast(STOP);
+                stopped = true;
+            }
+        }
+        /* make sure the others hear that we stopped, but do not wait long for a peer that is already gone */
+        const auto flushDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        for(bool pending = true; pending && std::chrono::steady_clock::now() < flushDeadline;) {
+            pending = false;
+            for(size_t other=0; other<peers.size(); ++other) {
+                if(other != rank && connections[other].out.size() > connections[other].outOffset) {
+                    pending = true;
+                }
+            }
+            if(pending) {
+                exchange(10);
+            }
+        }
+        return result;
+    }
+};
+
+}
+
+#endif /* #ifndef ASTAR_DISTRIBUTED */
@@ -0,0 +1,197 @@
+#ifndef ASTAR_EXPECTIMAX
+#define ASTAR_EXPECTIMAX
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+#include <unordered_set>
+#include <functional>
+#include <chrono>
+#include <algorithm>
+
+namespace astar {
+
+/* Depth-limited expectimax for single-player games in which some moves reveal hidden information.  `T` is
+ * what the player can see of the game: its successors() are ordinary positions, except that a move which
+ * turns something over leads to a chance state (T::isPending()) that the search must not look inside.
+ * Instead, the `Model` supplies outcomes for it:
+ *
+ *     double evaluate(const T&) const;    // an estimate in [0, 1] of the chance of winning from a position
+ *     template <class Rng> void sample(const T& parent, const T& pending, size_t n, Rng&, std::vector<T>& out) const;
+ *                                         // n equally likely positions the move into `pending` might lead to
+ *
+ * A chance state is valued by sparse sampling, as the mean over `width` sampled outcomes.  Since every
+ * value lies in [0, 1], the mean is bounded after each sample, so a chance state is cut off as soon as it
+ * cannot beat the best move found so far (or cannot fail to beat the caller's bound), as in Star1.  Values
+ * are kept in a transposition table keyed on std::hash<T>, which should only depend on the visible state;
+ * like FingerprintHistory, colliding keys are not told apart. */
+template <class T, class Model, class Rng>
+class Expectimax {
+private:
+    struct Entry {
+        size_t key;
+        float lower;
+        float upper;
+        uint8_t depth;
+        /* the index of the best successor last time, tried first next time */
+        uint8_t best;
+        /* whether every line below was played out to the end, so that the value holds at any depth */
+        bool resolved;
+        Entry() : key(0), lower(0), upper(1), depth(0), best(0), resolved(false) {}
+    };
+    struct Timeout {};
+    const Model& model;
+    Rng& rng;
+    size_t width;
+    std::vector<Entry> table;
+    size_t tableMask;
+    size_t nodesExpanded;
+    /* whether the subtree being searched has had any line cut off at its depth limit */
+    bool reachedHorizon;
+    std::chrono::steady_clock::time_point deadline;
+    static inline size_t keyOf(const T& state) {
+        /* zero marks an empty slot */
+        return std::hash<T>()(state) | 1;
+    }
+    void checkTime() {
+        if((++nodesExpanded & 0x3FF) == 0 && std::chrono::steady_clock::now() >= deadline) {
+            throw Timeout();
+        }
+    }
+    double chanceValue(const T& parent, const T& pending, unsigned depth, double alpha, double beta) {
+        std::vector<T> outcomes;
+        model.sample(parent, pending, width, rng, outcomes);
+        const double n = static_cast<double>(outcomes.size());
+        double sum = 0.0;
+        for(size_t k=0; k<outcomes.size(); ++k) {
+            const double remaining = n - k - 1;
+            /* the range of values for this outcome that can still change whether the mean is inside (alpha, beta) */
+            const double low = std::max(0.0, n * alpha - sum - remaining);
+            const double high = std::min(1.0, n * beta - sum);
+            sum += value(outcomes[k], depth, low, high);
+            if(sum + remaining <= n * alpha) {
+                return (sum + remaining) / n;
+            } else if(sum >= n * beta) {
+                return sum / n;
+            }
+        }
+        return sum / n;
+    }
+    double value(const T& state, unsigned depth, double alpha, double beta) {
+        if(state.isWin()) {
+            return 1.0;
+        } else if(depth == 0) {
+            reachedHorizon = true;
+            return model.evaluate(state);
+        }
+        checkTime();
+        const size_t key = keyOf(state);
+        Entry& probe = table[key & tableMask];
+        size_t first = 0;
+        if(probe.key == key) {
+            first = probe.best;
+            if(probe.depth >= depth || probe.resolved) {
+                if(probe.lower >= beta || probe.lower == probe.upper) {
+                    reachedHorizon |= !probe.resolved;
+                    return probe.lower;
+                } else if(probe.upper <= alpha) {
+                    reachedHorizon |= !probe.resolved;
+                    return probe.upper;
+                }
+                alpha = std::max<double>(alpha, probe.lower);
+                beta = std::min<double>(beta, probe.upper);
+            }
+        }
+        const bool horizonAbove = reachedHorizon;
+        reachedHorizon = false;
+        const std::vector<T> successors = state.successors();
+        double best = 0.0;
+        size_t bestIndex = 0;
+        if(first >= successors.size()) {
+            first = 0;
+        }
+        for(size_t i=0; i<successors.size() && best < beta; ++i) {
+            /* the previous best first, then the rest in their usual order */
+            const size_t index = i == 0 ? first : (i <= first ? i - 1 : i);
+            const T& child = successors[index];
+            const double bound = std::max(alpha, best);
+            const double v = child.isPending() ? chanceValue(state, child, depth - 1, bound, beta) : value(child, depth - 1, bound, beta);
+            if(v > best || i == 0) {
+                best = v;
+                bestIndex = index;
+            }
+        }
+        Entry& entry = table[key & tableMask];
+        if(entry.key != key || entry.depth <= depth || !reachedHorizon) {
+            entry.key = key;
+            entry.depth = static_cast<uint8_t>(std::min(depth, 255u));
+            entry.best = static_cast<uint8_t>(bestIndex);
+            entry.lower = best > alpha ? best : 0.0f;
+            entry.upper = best < beta ? best : 1.0f;
+            entry.resolved = !reachedHorizon;
+        }
+        reachedHorizon |= horizonAbove;
+        return best;
+    }
+public:
+    /* the transposition table has 2^tableBits entries; `width` outcomes are sampled for each chance state */
+    Expectimax(const Model& model, Rng& rng, size_t width = 8, unsigned tableBits = 20) : model(model), rng(rng), width(width), table(static_cast<size_t>(1) << tableBits), tableMask((static_cast<size_t>(1) << tableBits) - 1), nodesExpanded(0), reachedHorizon(false) {}
+    inline size_t getNodesExpanded() const { return nodesExpanded; }
+    struct Result {
+        /* the index of the chosen successor of the root, or -1 if there was nothing to choose */
+        int index;
+        double value;
+        unsigned depth;
+    };
+    /* Iterative deepening until `timeLimit` runs out; successors of `root` that are in `history` are skipped.
+     * The result is from the deepest search that finished, or from depth one if none did. */
+    Result solve(const T& root, std::chrono::milliseconds timeLimit, const std::unordered_set<T>& history, const std::function<void(const Result&)>& callback = [](const Result&) {}) {
+        Result result = { -1, 0.0, 0 };
+        const std::vector<T> successors = root.successors();
+        std::vector<size_t> candidates;
+        for(size_t i=0; i<successors.size(); ++i) {
+            if(!history.count(successors[i])) {
+                candidates.push_back(i);
+            }
+        }
+        if(candidates.empty()) {
+            return result;
+        }
+        result.index = static_cast<int>(candidates.front());
+        deadline = std::chrono::steady_clock::now() + timeLimit;
+        for(unsigned depth=1; depth<256; ++depth) {
+            Result iteration = { result.index, -1.0, depth };
+            reachedHorizon = false;
+            try {
+                /* the previous iteration's choice first, so that it sets the bound for the others */
+                std::stable_partition(candidates.begin(), candidates.end(), [&result](size_t index) { return static_cast<int>(index) == result.index; });
+                for(size_t index : candidates) {
+                    const T& child = successors[index];
+                    const double bound = std::max(iteration.value, 0.0);
+                    const double v = child.isPending() ? chanceValue(root, child, depth - 1, bound, 1.0) : value(child, depth - 1, bound, 1.0);
+                    if(v > iteration.value) {
+                        iteration.index = static_cast<int>(index);
+                        iteration.value = v;
+                    }
+                }
+            } catch(const Timeout&) {
+                if(result.depth == 0) {
+                    result = iteration;
+                    result.value = std::max(result.value, 0.0);
+                }
+                break;
+            }
+            result = iteration;
+            callback(result);
+            /* if nothing was cut off, searching deeper would not change anything */
+            if(result.value >= 1.0 || !reachedHorizon || std::chrono::steady_clock::now() >= deadline) {
+                break;
+            }
+        }
+        return result;
+    }
+};
+
+}
+
+#endif /* #ifndef ASTAR_EXPECTIMAX */
@@ -0,0 +1,495 @@
+#ifndef ASTAR_HISTORY
+#define ASTAR_HISTORY
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+#include <unordered_set>
+#include <unordered_map>
+#include <functional>
+#include <stdexcept>
+#include <cmath>
+#include <cstdlib>
+#include <utility>
+#include <cstring>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace astar {
+
+/* The closed list ("history") of an AStar search is a policy: anything that can record a state, say
+ * whether it has been seen before, and optionally hand back a stored copy of it.  Policies that do not
+ * retain states return a null state pointer, in which case the search keeps its own copy of each
+ * frontier state until it is expanded, or only its index if the policy can rebuild it. */
+
+static constexpr size_t NO_PARENT = ~static_cast<size_t>(0);
+
+/* the splitmix64 finalizer; a cheap way to spread every input bit over the whole word */
+inline uint64_t mix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/* a 128-bit state fingerprint; the all-zero value is reserved to mark empty hash table slots */
+struct Fingerprint {
+    uint64_t low;
+    uint64_t high;
+    Fingerprint() : low(0), high(0) {}
+    Fingerprint(uint64_t low, uint64_t high) : low(low | (low == 0 && high == 0)), high(high) {}
+    inline bool empty() const { return low == 0 && high == 0; }
+    inline bool operator==(const Fingerprint& other) const { return low == other.low && high == other.high; }
+    inline bool operator!=(const Fingerprint& other) const { return !(*this == other); }
+};
+
+template <class T>
+struct HistoryEntry {
+    const T* state;
+    size_t index;
+    bool inserted;
+    HistoryEntry(const T* state, size_t index, bool inserted) : state(state), index(index), inserted(inserted) {}
+};
+
+template <class T>
+class ExactHistory {
+private:
+    std::unordered_set<T> states;
+public:
+    HistoryEntry<T> insert(const T& state, size_t parent = NO_PARENT) {
+        (void)parent;
+        auto result = states.insert(state);
+        return HistoryEntry<T>(&*result.first, 0, result.second);
+    }
+    inline bool contains(const T& state) const { return states.find(state) != states.end(); }
+    inline size_t size() const { return states.size(); }
+};
+
+/* Stores only a fingerprint, the index of the parent entry, and the 16-bit packed move that led from the
+ * parent, which is 16 bytes per state.  Every `snapshotInterval` moves along a path a full copy of the
+ * state is kept; any other state is rebuilt on demand by replaying moves from the nearest snapshot.
+ * Fingerprint matches are confirmed by rebuilding, so duplicate detection stays exact, and a search can
+ * keep just the index of each frontier state (see HistoryRebuilder).  T must provide `applyMove()` and a
+ * move type with `pack()` and a static `unpack()`. */
+template <class T>
+class DeltaHistory {
+public:
+    typedef decltype(std::declval<const T&>().getLastMove()) MoveType;
+private:
+    struct Entry {
+        uint64_t fingerprint;
+        /* for a snapshot, which has no moves to replay, the index of its copy in `snapshots` instead */
+        uint32_t parent;
+        uint16_t move;
+        uint16_t snapshotDistance;
+    };
+    static_assert(sizeof(Entry) == 16, "DeltaHistory entries are expected to pack into 16 bytes");
+    static constexpr uint32_t NONE = ~static_cast<uint32_t>(0);
+    std::vector<Entry> entries;
+    std::vector<T> snapshots;
+    /* open-addressed index into `entries`; each slot holds an entry index plus one, or zero if empty */
+    std::vector<uint32_t> table;
+    unsigned snapshotInterval;
+    mutable std::vector<uint16_t> replayBuffer;
+
+    void grow() {
+        std::vector<uint32_t> oldTable(table.size() ? table.size() * 2 : 1024, 0);
+        oldTable.swap(table);
+        const size_t mask = table.size() - 1;
+        for(uint32_t slot : oldTable) {
+            if(slot) {
+                size_t i = entries[slot - 1].fingerprint & mask;
+                while(table[i]) {
+                    i = (i + 1) & mask;
+                }
+                table[i] = slot;
+            }
+        }
+    }
+public:
+    DeltaHistory(unsigned snapshotInterval = 16) : snapshotInterval(snapshotInterval ? snapshotInterval : 1) {
+        grow();
+    }
+    T rebuild(size_t index) const {
+        replayBuffer.clear();
+        size_t i = index;
+        while(entries[i].snapshotDistance > 0) {
+            replayBuffer.push_back(entries[i].move);
+            i = entries[i].parent;
+        }
+        T state = snapshots[entries[i].parent];
+        for(auto move = replayBuffer.rbegin(); move != replayBuffer.rend(); ++move) {
+            state = state.applyMove(MoveType::unpack(*move));
+        }
+        return state;
+    }
+    HistoryEntry<T> insert(const T& state, size_t parent = NO_PARENT) {
+        const uint64_t fingerprint = std::hash<T>()(state);
+        const size_t mask = table.size() - 1;
+        size_t i = fingerprint & mask;
+        for(; table[i]; i = (i + 1) & mask) {
+            const size_t candidate = table[i] - 1;
+            if(entries[candidate].fingerprint == fingerprint && rebuild(candidate) == state) {
+                return HistoryEntry<T>(nullptr, candidate, false);
+            }
+        }
+        if(entries.size() >= NONE - 1) {
+            throw std::runtime_error("DeltaHistory is full!");
+        }
+        Entry entry;
+        entry.fingerprint = fingerprint;
+        entry.parent = parent == NO_PARENT ? NONE : static_cast<uint32_t>(parent);
+        entry.move = state.getLastMove().pack();
+        entry.snapshotDistance = entry.parent == NONE ? 0 : entries[entry.parent].snapshotDistance + 1;
+        const uint32_t index = static_cast<uint32_t>(entries.size());
+        if(entry.snapshotDistance >= snapshotInterval) {
+            entry.snapshotDistance = 0;
+        }
+        if(entry.snapshotDistance == 0) {
+            entry.parent = static_cast<uint32_t>(snapshots.size());
+            snapshots.push_back(state);
+        }
+        entries.push_back(entry);
+        table[i] = index + 1;
+        if(entries.size() * 2 > table.size()) {
+            grow();
+        }
+        return HistoryEntry<T>(nullptr, index, true);
+    }
+    bool contains(const T& state) const {
+        const uint64_t fingerprint = std::hash<T>()(state);
+        const size_t mask = table.size() - 1;
+        for(size_t i = fingerprint & mask; table[i]; i = (i + 1) & mask) {
+            if(entries[table[i] - 1].fingerprint == fingerprint && rebuild(table[i] - 1) == state) {
+                return true;
+            }
+        }
+        return false;
+    }
+    inline size_t size() const { return entries.size(); }
+    inline size_t getNumSnapshots() const { return snapshots.size(); }
+};
+
+/* Whether a search can keep only the index of a frontier state that the History does not retain, and rebuild
+ * the state from the History when it is expanded, instead of keeping a copy.  Only a DeltaHistory can. */
+template <class T, class History>
+struct HistoryRebuilder {
+    static constexpr bool CAN_REBUILD = false;
+    static inline T rebuild(const History&, size_t) { throw std::logic_error("This history cannot rebuild states"); }
+};
+
+template <class T>
+struct HistoryRebuilder<T, DeltaHistory<T>> {
+    static constexpr bool CAN_REBUILD = true;
+    static inline T rebuild(const DeltaHistory<T>& history, size_t index) { return history.rebuild(index); }
+};
+
+/* Duplicate detection by 128-bit fingerprint alone, using `T::fingerprint()`.  Entries are 16 bytes in a
+ * flat, linearly-probed table, so a lookup almost always touches a single cache line.  At the scale of our
+ * searches the chance of two distinct states sharing a fingerprint is negligible, but with `crossCheck`
+ * (the default in debug builds) every state is also kept so that matches can be verified exactly. */
+template <class T>
+class FingerprintHistory {
+private:
+    struct FingerprintHash {
+        inline size_t operator()(const Fingerprint& fingerprint) const { return fingerprint.low; }
+    };
+    std::vector<Fingerprint> table;
+    size_t numEntries;
+    bool crossCheck;
+    std::unordered_map<Fingerprint, T, FingerprintHash> checkedStates;
+    size_t numCollisions;
+
+    void grow() {
+        std::vector<Fingerprint> oldTable(table.size() ? table.size() * 2 : 1024);
+        oldTable.swap(table);
+        const size_t mask = table.size() - 1;
+        for(const Fingerprint& fingerprint : oldTable) {
+            if(!fingerprint.empty()) {
+                size_t i = fingerprint.low & mask;
+                while(!table[i].empty()) {
+                    i = (i + 1) & mask;
+                }
+                table[i] = fingerprint;
+            }
+        }
+    }
+public:
+#ifdef NDEBUG
+    FingerprintHistory(bool crossCheck = false)
+#else
+    FingerprintHistory(bool crossCheck = true)
+#endif
+        : numEntries(0), crossCheck(crossCheck), numCollisions(0) {
+        grow();
+    }
+    HistoryEntry<T> insert(const T& state, size_t parent = NO_PARENT) {
+        (void)parent;
+        const Fingerprint fingerprint = state.fingerprint();
+        const size_t mask = table.size() - 1;
+        size_t i = fingerprint.low & mask;
+        for(; !table[i].empty(); i = (i + 1) & mask) {
+            if(table[i] == fingerprint) {
+                if(crossCheck && !(checkedStates.at(fingerprint) == state)) {
+                    ++numCollisions;
+                    assert(!"Two distinct states share a fingerprint");
+                }
+                return HistoryEntry<T>(nullptr, i, false);
+            }
+        }
+        table[i] = fingerprint;
+        if(crossCheck) {
+            checkedStates.emplace(fingerprint, state);
+        }
+        if(++numEntries * 2 > table.size()) {
+            grow();
+        }
+        return HistoryEntry<T>(nullptr, i, true);
+    }
+    bool contains(const T& state) const {
+        const Fingerprint fingerprint = state.fingerprint();
+        const size_t mask = table.size() - 1;
+        for(size_t i = fingerprint.low & mask; !table[i].empty(); i = (i + 1) & mask) {
+            if(table[i] == fingerprint) {
+                return true;
+            }
+        }
+        return false;
+    }
+    inline size_t size() const { return numEntries; }
+    inline size_t getNumCollisions() const { return numCollisions; }
+};
+
+/* An approximate closed list for searches that can trade completeness for memory: a blocked Bloom filter
+ * sized from the expected number of states and a target false positive rate, typically a few bits per
+ * state.  Each fingerprint maps to a single 512-bit block, so a probe touches one cache line.  A false
+ * positive silently prunes a state that was never actually seen.  A new state probing a block with a fill
+ * of f is let through with probability 1 - f^k, so each one that is inserted stands for f^k / (1 - f^k)
+ * expected false positives at that fill; their running sum estimates the number of false prunes. */
+template <class T>
+class BloomHistory {
+private:
+    static constexpr size_t WORDS_PER_BLOCK = 8;
+    static constexpr size_t BITS_PER_BLOCK = WORDS_PER_BLOCK * 64;
+    struct alignas(64) Block {
+        uint64_t words[WORDS_PER_BLOCK];
+    };
+    std::vector<Block> blocks;
+    unsigned numHashes;
+    size_t numEntries;
+    size_t numPruned;
+    double estimatedFalsePrunes;
+
+    /* sets (or, if `probeOnly`, just checks) the state's bits, returning whether they were all set already and
+     * the number of bits that were set in its block beforehand */
+    bool probe(const Fingerprint& fingerprint, bool probeOnly, unsigned& blockPopulation) {
+        Block& block = blocks[static_cast<size_t>((static_cast<unsigned __int128>(fingerprint.high) * blocks.size()) >> 64)];
+        blockPopulation = 0;
+        for(size_t w=0; w<WORDS_PER_BLOCK; ++w) {
+            blockPopulation += __builtin_popcountll(block.words[w]);
+        }
+        const uint32_t h1 = static_cast<uint32_t>(fingerprint.low);
+        const uint32_t h2 = static_cast<uint32_t>(fingerprint.low >> 32) | 1;
+        bool allSet = true;
+        for(unsigned i=0; i<numHashes; ++i) {
+            const uint32_t bit = (h1 + i * h2) % BITS_PER_BLOCK;
+            const uint64_t mask = 1ULL << (bit % 64);
+            if(!(block.words[bit / 64] & mask)) {
+                allSet = false;
+                if(probeOnly) {
+                    break;
+                }
+                block.words[bit / 64] |= mask;
+            }
+        }
+        return allSet;
+    }
+public:
+    BloomHistory(size_t expectedStates = 1 << 20, double falsePositiveRate = 0.001) : numEntries(0), numPruned(0), estimatedFalsePrunes(0.0) {
+        if(expectedStates < 1) {
+            expectedStates = 1;
+        }
+        falsePositiveRate = std::min(std::max(falsePositiveRate, 1e-9), 0.5);
+        const double bitsPerState = -std::log(falsePositiveRate) / (std::log(2.0) * std::log(2.0));
+        numHashes = std::max(1u, std::min(16u, static_cast<unsigned>(std::lround(bitsPerState * std::log(2.0)))));
+        const size_t numBits = static_cast<size_t>(std::ceil(bitsPerState * expectedStates));
+        blocks.resize((numBits + BITS_PER_BLOCK - 1) / BITS_PER_BLOCK, Block());
+    }
+    HistoryEntry<T> insert(const T& state, size_t parent = NO_PARENT) {
+        (void)parent;
+        unsigned blockPopulation;
+        if(probe(state.fingerprint(), false, blockPopulation)) {
+            ++numPruned;
+            return HistoryEntry<T>(nullptr, 0, false);
+        }
+        /* the block was not full, or every bit would have been set */
+        const double falsePositiveChance = std::pow(static_cast<double>(blockPopulation) / BITS_PER_BLOCK, numHashes);
+        estimatedFalsePrunes += falsePositiveChance / (1.0 - falsePositiveChance);
+        ++numEntries;
+        return HistoryEntry<T>(nullptr, 0, true);
+    }
+    bool contains(const T& state) const {
+        unsigned blockPopulation;
+        return const_cast<BloomHistory*>(this)->probe(state.fingerprint(), true, blockPopulation);
+    }
+    inline size_t size() const { return numEntries; }
+    inline size_t getNumPruned() const { return numPruned; }
+    /* the expected number of new states pruned as false positives so far */
+    inline double getEstimatedFalsePrunes() const { return estimatedFalsePrunes; }
+    inline size_t getMemoryUsage() const { return blocks.size() * sizeof(Block); }
+};
+
+/* Makes an empty History for a search expected to insert about `expectedStates` states.  Only histories with a
+ * fixed capacity use the hint (a BloomHistory is zeroed in full when it is made, so one sized for far more
+ * states than a short search visits costs more than the search); the others grow as they need to. */
+template <class History>
+struct HistoryFactory {
+    static inline History make(size_t) { return History(); }
+};
+
+template <class T>
+struct HistoryFactory<BloomHistory<T>> {
+    static inline BloomHistory<T> make(size_t expectedStates) { return BloomHistory<T>(expectedStates); }
+};
+
+/* An insert-only, open-addressed hash set of fixed-size keys stored inline, laid out like a SwissTable: one
+ * control byte per slot holding seven bits of the key's hash (or EMPTY), scanned sixteen slots at a time
+ * with SSE2 so that a full key comparison (a memcmp, which never allocates) is only made on a tag match. */
+template <class Key>
+class FlatSet {
+private:
+    static_assert(sizeof(Key) % sizeof(uint64_t) == 0, "FlatSet keys must be a whole number of 64-bit words");
+    static constexpr size_t GROUP_SIZE = 16;
+    static constexpr int8_t EMPTY = -128;
+    int8_t* control;
+    Key* keys;
+    size_t numGroups;
+    size_t numEntries;
+
+    static uint64_t hash(const Key& key) {
+        uint64_t h = 0;
+        for(size_t i=0; i<sizeof(Key); i += sizeof(uint64_t)) {
+            uint64_t word;
+            memcpy(&word, reinterpret_cast<const uint8_t*>(&key) + i, sizeof(word));
+            h = mix64(h ^ word);
+        }
+        return h;
+    }
+    /* a bitmask of the slots in the group whose control byte equals `tag` */
+    static inline uint32_t match(const int8_t* group, int8_t tag) {
+#ifdef __SSE2__
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(group)), _mm_set1_epi8(tag))));
+#else
+        uint32_t mask = 0;
+        for(size_t i=0; i<GROUP_SIZE; ++i) {
+            mask |= static_cast<uint32_t>(group[i] == tag) << i;
+        }
+        return mask;
+#endif
+    }
+    /* returns the slot holding `key`, or the empty slot where it belongs, and whether it was found */
+    std::pair<size_t,bool> find(const Key& key, uint64_t h) const {
+        const int8_t tag = static_cast<int8_t>(h & 0x7F);
+        const size_t mask = numGroups - 1;
+        for(size_t group = (h >> 7) & mask, step = 1;; group = (group + step++) & mask) {
+            const int8_t* groupControl = &control[group * GROUP_SIZE];
+            for(uint32_t candidates = match(groupControl, tag); candidates; candidates &= candidates - 1) {
+                const size_t slot = group * GROUP_SIZE + __builtin_ctz(candidates);
+                if(memcmp(&keys[slot], &key, sizeof(Key)) == 0) {
+                    return std::make_pair(slot, true);
+                }
+            }
+            if(uint32_t empty = match(groupControl, EMPTY)) {
+                return std::make_pair(group * GROUP_SIZE + __builtin_ctz(empty), false);
+            }
+        }
+    }
+    void allocate(size_t groups) {
+        void* memory;
+        numGroups = groups;
+        if(posix_memalign(&memory, 64, groups * GROUP_SIZE)) {
+            throw std::bad_alloc();
+        }
+        control = static_cast<int8_t*>(memory);
+        memset(control, EMPTY, groups * GROUP_SIZE);
+        if(posix_memalign(&memory, 64, groups * GROUP_SIZE * sizeof(Key))) {
+            free(control);
+            throw std::bad_alloc();
+        }
+        keys = static_cast<Key*>(memory);
+    }
+    void grow() {
+        int8_t* oldControl = control;
+        Key* oldKeys = keys;
+        const size_t oldSlots = numGroups * GROUP_SIZE;
+        allocate(numGroups * 2);
+        for(size_t slot=0; slot<oldSlots; ++slot) {
+            if(oldControl[slot] != EMPTY) {
+                const uint64_t h = hash(oldKeys[slot]);
+                const size_t newSlot = find(oldKeys[slot], h).first;
+                control[newSlot] = static_cast<int8_t>(h & 0x7F);
+                keys[newSlot] = oldKeys[slot];
+            }
+        }
+        free(oldControl);
+        free(oldKeys);
+    }
+public:
+    FlatSet(size_t initialGroups = 64) : control(nullptr), keys(nullptr), numGroups(0), numEntries(0) {
+        size_t groups = 1;
+        while(groups < initialGroups) {
+            groups <<= 1;
+        }
+        allocate(groups);
+    }
+    FlatSet(const FlatSet&) = delete;
+    FlatSet& operator=(const FlatSet&) = delete;
+    FlatSet(FlatSet&& move) : control(move.control), keys(move.keys), numGroups(move.numGroups), numEntries(move.numEntries) {
+        move.control = nullptr;
+        move.keys = nullptr;
+        move.numGroups = 0;
+        move.numEntries = 0;
+    }
+    ~FlatSet() {
+        free(control);
+        free(keys);
+    }
+    /* returns false if the key was already present */
+    bool insert(const Key& key) {
+        if((numEntries + 1) * 8 > numGroups * GROUP_SIZE * 7) {
+            grow();
+        }
+        const uint64_t h = hash(key);
+        const std::pair<size_t,bool> slot = find(key, h);
+        if(slot.second) {
+            return false;
+        }
+        control[slot.first] = static_cast<int8_t>(h & 0x7F);
+        keys[slot.first] = key;
+        ++numEntries;
+        return true;
+    }
+    inline bool contains(const Key& key) const { return find(key, hash(key)).second; }
+    inline size_t size() const { return numEntries; }
+};
+
+/* Exact duplicate detection without storing full states: each state is reduced to its fixed-size, canonical
+ * `T::pack()` image and kept inline in a FlatSet. */
+template <class T>
+class PackedHistory {
+private:
+    typedef decltype(std::declval<const T&>().pack()) Key;
+    FlatSet<Key> states;
+public:
+    HistoryEntry<T> insert(const T& state, size_t parent = NO_PARENT) {
+        (void)parent;
+        return HistoryEntry<T>(nullptr, 0, states.insert(state.pack()));
+    }
+    inline bool contains(const T& state) const { return states.contains(state.pack()); }
+    inline size_t size() const { return states.size(); }
+};
+
+}
+
+#endif /* #ifndef ASTAR_HISTORY */
@@ -1,9 +1,22 @@
 #include <cassert>
+#include <climits>
+#include <cstring>
+#include <atomic>
+#include <new>
 #include <iostream>
 #include <sstream>
 #include <random>
 #include <chrono>
 #include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 namespace std {
     template <typename T>
@@ -22,6 +35,11 @@ namespace std {
 }
 
 #include "astar.h"
+#include "expectimax.h"
+#include "subgoal.h"
+#include "distributed.h"
+#include "threadpool.h"
+#include "sequential.h"
 
 enum class Color : bool {
     BLACK = 1,
@@ -60,7 +78,6 @@ private:
 public:
     Card() : rawCard(0) {}
     Card(CardValue value, Suit suit) : rawCard((std::enum_value(value) << 2) | std::enum_value(suit)) {}
-    Card(const Card& copy) : rawCard(copy.rawCard) {}
     inline Suit getSuit() const {
         return static_cast<Suit>(rawCard & 0b00000011);
     }
@@ -70,13 +87,13 @@ public:
     inline Color getColor() const {
         return static_cast<Color>((std::enum_value(getSuit()) % 2) == 0);
     }
-    Card& operator=(const Card& copy) {
-        rawCard = copy.rawCard;
-        return *this;
-    }
     inline Card operator+(size_t offset) const {
         return Card(rawCard + (offset << 2));
     }
+    inline uint8_t getRaw() const { return rawCard; }
+    /* a dense index from 0 (the ace of hearts) to 51 (the king of clubs) */
+    inline uint8_t getIndex() const { return rawCard - 4; }
+    static inline Card fromIndex(size_t index) { return Card(static_cast<uint8_t>(index + 4)); }
     inline bool isKnown() const { return getValue() != CardValue::UNKNOWN && getValue() != CardValue::EMPTY; }
     static Card UNKNOWN;
     static Card EMPTY;
@@ -166,53 +183,94 @@ public:
 
 class CardPile {
 protected:
+    /* Piles are immutable once they are shared: the cards live in a reference-counted block that a state
+     * shares with all of its successors, so a move only allocates the (at most three) piles it changes. */
+    class Block {
+    private:
+        std::atomic<unsigned> references;
+        Block() : references(1) {}
+    public:
+        static Block* allocate(size_t numCards) {
+            return new(::operator new(sizeof(Block) + sizeof(Card) * numCards)) Block();
+        }
+        inline Card* cards() { return reinterpret_cast<Card*>(this + 1); }
+        inline bool isShared() const { return references.load(std::memory_order_acquire) > 1; }
+        inline Block* retain() {
+            references.fetch_add(1, std::memory_order_relaxed);
+            return this;
+        }
+        inline void release() {
+            if(references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                this->~Block();
+                ::operator delete(this);
+            }
+        }
+    };
     uint8_t internalSize;
     uint8_t numHidden;
-    Card* pile;
+    Block* block;
+    inline const Card* pile() const { return block->cards(); }
+    /* gives this pile a private copy of its cards, if they are shared, so that they can be modified */
+    void detach() {
+        if(block && block->isShared()) {
+            Block* copy = Block::allocate(internalSize);
+            memcpy(copy->cards(), block->cards(), sizeof(Card) * internalSize);
+            block->release();
+            block = copy;
+        }
+    }
 public:
-    CardPile() : internalSize(0), numHidden(0), pile(nullptr) {}
-    CardPile(uint_fast8_t numCards, uint_fast8_t numHidden) : internalSize(numCards), numHidden(numHidden), pile(new Card[internalSize]) {
-        if(numHidden > internalSize) {
-            numHidden = internalSize;
+    CardPile() : internalSize(0), numHidden(0), block(nullptr) {}
+    CardPile(uint_fast8_t numCards, uint_fast8_t numHidden) : internalSize(numCards), numHidden(numHidden), block(numCards ? Block::allocate(numCards) : nullptr) {
+        if(this->numHidden > internalSize) {
+            this->numHidden = internalSize;
         }
     };
-    CardPile(const CardPile& copy) : CardPile(copy.internalSize, copy.numHidden) {
-        memcpy(pile, copy.pile, sizeof(Card) * internalSize);
-    }
-    CardPile(CardPile&& move) : internalSize(move.internalSize), numHidden(move.numHidden), pile(move.pile) {
-        move.pile = nullptr;
+    CardPile(const CardPile& copy) : internalSize(copy.internalSize), numHidden(copy.numHidden), block(copy.block ? copy.block->retain() : nullptr) {}
+    CardPile(CardPile&& move) : internalSize(move.internalSize), numHidden(move.numHidden), block(move.block) {
+        move.block = nullptr;
         move.internalSize = 0;
         move.numHidden = 0;
     }
     virtual ~CardPile() {
-        if(pile) {
-            delete pile;
+        if(block) {
+            block->release();
         }
     }
     virtual CardPile& operator=(const CardPile& copy) {
-        delete pile;
+        if(copy.block) {
+            copy.block->retain();
+        }
+        if(block) {
+            block->release();
+        }
         internalSize = copy.internalSize;
         numHidden = copy.numHidden;
-        pile = new Card[internalSize];
-        memcpy(pile, copy.pile, sizeof(Card) * internalSize);
+        block = copy.block;
         return *this;
     }
     virtual CardPile& operator=(CardPile&& move) {
-        delete pile;
-        internalSize = move.internalSize;
-        numHidden = move.numHidden;
-        pile = move.pile;
-        move.pile = nullptr;
-        move.internalSize = 0;
-        move.numHidden = 0;
+        if(this != &move) {
+            if(block) {
+                block->release();
+            }
+            internalSize = move.internalSize;
+            numHidden = move.numHidden;
+            block = move.block;
+            move.block = nullptr;
+            move.internalSize = 0;
+            move.numHidden = 0;
+        }
         return *this;
     }
     virtual bool operator==(const CardPile& other) const {
         if(size() != other.size() || getNumHidden() != other.getNumHidden()) {
             return false;
+        } else if(block == other.block) {
+            return true;
         }
         for(size_t i=0; i<internalSize; ++i) {
-            if(pile[i] != other.pile[i]) {
+            if(pile()[i] != other.pile()[i]) {
                 return false;
             }
         }
@@ -228,17 +286,20 @@ public:
         } else if(index >= internalSize) {
             return Card::EMPTY;
         } else {
-            return pile[index];
+            return pile()[index];
         }
     }
     void set(size_t index, const Card& card) {
-        pile[index] = card;
+        detach();
+        block->cards()[index] = card;
     }
     CardPile addTop(Card newCard) const {
         assert(newCard.isKnown());
         CardPile ret(internalSize + 1, numHidden);
-        memcpy(ret.pile, pile, sizeof(Card) * internalSize);
-        ret.pile[internalSize] = newCard;
+        if(internalSize > 0) {
+            memcpy(ret.block->cards(), pile(), sizeof(Card) * internalSize);
+        }
+        ret.block->cards()[internalSize] = newCard;
         return ret;
     }
     CardPile addTop(const CardPile& copyFrom, signed numCards = -1) const {
@@ -250,19 +311,38 @@ public:
             assert(copyFrom[copyFrom.size()-i].isKnown());
         }
 #endif
+        if(numCards == 0) {
+            return *this;
+        }
         CardPile ret(internalSize + numCards, numHidden);
-        memcpy(ret.pile, pile, sizeof(Card) * internalSize);
-        if(numCards > 0) {
-            memcpy(&ret.pile[internalSize], &copyFrom.pile[copyFrom.size() - numCards], sizeof(Card) * numCards);
+        if(internalSize > 0) {
+            memcpy(ret.block->cards(), pile(), sizeof(Card) * internalSize);
+        }
+        memcpy(&ret.block->cards()[internalSize], &copyFrom.pile()[copyFrom.size() - numCards], sizeof(Card) * numCards);
+        return ret;
+    }
+    /* removes the card at `index`, wherever it is in the pile */
+    CardPile remove(size_t index) const {
+        assert(index < internalSize);
+        if(index + 1 == internalSize) {
+            return removeTop();
         }
+        CardPile ret(internalSize - 1, numHidden > index ? numHidden - 1 : numHidden);
+        memcpy(ret.block->cards(), pile(), sizeof(Card) * index);
+        memcpy(&ret.block->cards()[index], &pile()[index + 1], sizeof(Card) * (internalSize - index - 1));
         return ret;
     }
     CardPile removeTop(size_t numToRemove = 1) const {
         if(numToRemove > size()) {
             numToRemove = size();
         }
-        CardPile ret(internalSize - numToRemove, numHidden);
-        memcpy(ret.pile, pile, sizeof(Card) * (internalSize - numToRemove));
+        /* the remaining cards are a prefix of ours, so they can keep sharing our block */
+        CardPile ret(*this);
+        ret.internalSize -= numToRemove;
+        if(ret.empty() && ret.block) {
+            ret.block->release();
+            ret.block = nullptr;
+        }
         if(ret.numHidden > ret.size()) {
             ret.numHidden = ret.size();
         }
@@ -270,8 +350,10 @@ public:
     }
     CardPile flip() const {
         CardPile ret(internalSize, 0);
-        memcpy(ret.pile, pile, sizeof(Card) * internalSize);
-        std::reverse(ret.pile, internalSize);
+        if(internalSize > 0) {
+            memcpy(ret.block->cards(), pile(), sizeof(Card) * internalSize);
+            std::reverse(ret.block->cards(), internalSize);
+        }
         return ret;
     }
     inline Card top() const {
@@ -282,7 +364,11 @@ public:
         }
     }
     inline Card revealTop() const {
-        return pile[internalSize - 1];
+        return pile()[internalSize - 1];
+    }
+    /* the card at `index`, even if it is face down */
+    inline Card reveal(size_t index) const {
+        return pile()[index];
     }
     inline Card revealTop() {
         if(empty()) {
@@ -290,7 +376,7 @@ public:
         } else if(numHidden == internalSize) {
             --numHidden;
         }
-        return pile[internalSize - 1];
+        return pile()[internalSize - 1];
     }
     inline Card bottom() const {
         if(empty()) {
@@ -299,39 +385,209 @@ public:
             return (*this)[0];
         }
     }
+    /* orders piles by size, then number of face-down cards, then contents */
+    int compare(const CardPile& other) const {
+        if(size() != other.size()) {
+            return size() < other.size() ? -1 : 1;
+        } else if(getNumHidden() != other.getNumHidden()) {
+            return getNumHidden() < other.getNumHidden() ? -1 : 1;
+        } else if(block == other.block || empty()) {
+            return 0;
+        }
+        return memcmp(pile(), other.pile(), sizeof(Card) * internalSize);
+    }
+    /* writes one byte per card, with bit 6 set on the face-down ones, and returns the end of the output */
+    uint8_t* pack(uint8_t* out) const {
+        for(size_t i=0; i<internalSize; ++i) {
+            *out++ = pile()[i].getRaw() | (i < numHidden ? 0x40 : 0);
+        }
+        return out;
+    }
+    /* a 64-bit digest of the pile's size, hidden count, and the first `numCards` cards, eight cards at a time */
+    uint64_t fingerprint(uint64_t seed, size_t numCards) const {
+        assert(numCards <= internalSize);
+        uint64_t h = astar::mix64(seed ^ (static_cast<uint64_t>(numCards) << 16) ^ (static_cast<uint64_t>(internalSize) << 8) ^ numHidden);
+        for(size_t i=0; i<numCards; i += sizeof(uint64_t)) {
+            uint64_t chunk = 0;
+            memcpy(&chunk, &pile()[i], sizeof(Card) * std::min(sizeof(uint64_t), numCards - i));
+            h = astar::mix64(h ^ chunk);
+        }
+        return h;
+    }
+    inline uint64_t fingerprint(uint64_t seed) const {
+        return fingerprint(seed, internalSize);
+    }
     virtual inline size_t hash() const {
         size_t h = 0;
         for(size_t i=0; i<internalSize; ++i) {
             /* shift left six bits (with looparound) and XOR with the next card: */
-            h = ((h >> 6) | (h << (CHAR_BIT * sizeof(h) - 6))) ^ ((std::enum_value(pile[i].getValue()) << 4) | std::enum_value(pile[i].getSuit()));
+            h = ((h >> 6) | (h << (CHAR_BIT * sizeof(h) - 6))) ^ ((std::enum_value(pile()[i].getValue()) << 4) | std::enum_value(pile()[i].getSuit()));
         }
         return h;
     }
 };
 
-class TableauPile : public CardPile {
+/* A tableau column.  The face-down cards are an ordinary (shared, immutable) CardPile, but the face-up part
+ * is always a descending run of alternating colors, so it is stored as its deepest card, its length, and
+ * one bit per card choosing between the two suits of the right color.  Moving any number of cards between
+ * columns is therefore O(1) and never allocates. */
+class TableauPile {
+private:
+    CardPile hidden;
+    Card runBase;
+    uint8_t runLength;
+    /* bit k is bit 1 of the suit of the card k above runBase; bit 0 of the suit (its color) alternates */
+    uint16_t runSuits;
+    inline Card faceUp(size_t k) const {
+        const uint8_t suit = ((std::enum_value(runBase.getSuit()) ^ k) & 1) | (((runSuits >> k) & 1) << 1);
+        return Card(static_cast<CardValue>(std::enum_value(runBase.getValue()) - k), static_cast<Suit>(suit));
+    }
 public:
-    TableauPile() : CardPile() {}
-    TableauPile(uint_fast8_t numCards, uint_fast8_t numHidden) : CardPile(numCards, numHidden) {}
-    TableauPile(const CardPile& copy) : CardPile(copy) {}
-    TableauPile(CardPile&& move) : CardPile(move) {}
-    virtual TableauPile& operator=(const CardPile& copy) {
-        return static_cast<TableauPile&>(CardPile::operator=(copy));
+    TableauPile() : runBase(Card::EMPTY), runLength(0), runSuits(0) {}
+    /* `hidden` must be entirely face down */
+    TableauPile(const CardPile& hidden, Card faceUp) : hidden(hidden), runBase(faceUp), runLength(1), runSuits(std::enum_value(faceUp.getSuit()) >> 1) {
+        assert(hidden.getNumHidden() == hidden.size());
     }
-    virtual TableauPile& operator=(CardPile&& move) {
-        return static_cast<TableauPile&>(CardPile::operator=(move));
+    TableauPile(const CardPile& hidden) : hidden(hidden), runBase(Card::EMPTY), runLength(0), runSuits(0) {
+        assert(hidden.getNumHidden() == hidden.size());
     }
-    virtual bool operator==(const TableauPile& other) const {
-        if(size() != other.size() || getNumHidden() != other.getNumHidden()) {
-            return false;
+    inline bool operator==(const TableauPile& other) const { return compare(other) == 0; }
+    inline bool operator!=(const TableauPile& other) const { return !(*this == other); }
+    inline size_t size() const { return hidden.size() + runLength; }
+    inline bool empty() const { return size() == 0; }
+    inline size_t getNumHidden() const { return hidden.size(); }
+    inline size_t getNumFaceUp() const { return runLength; }
+    /* the deepest face-up card, i.e., the highest-ranked card of the run */
+    inline Card getRunBase() const { return runLength ? runBase : Card::EMPTY; }
+    inline Card operator[](size_t index) const {
+        if(index < hidden.size()) {
+            return Card();
+        } else if(index >= size()) {
+            return Card::EMPTY;
+        } else {
+            return faceUp(index - hidden.size());
         }
-        return empty() || (pile[0].getColor() == other.pile[0].getColor() && pile[0].getValue() == other.pile[0].getValue());
     }
-    virtual inline size_t hash() const {
-        size_t h = empty() ? 0 : std::enum_value(pile[0].getValue()) << 4 | std::enum_value(pile[0].getSuit());
+    /* the card at `index`, even if it is face down */
+    inline Card reveal(size_t index) const {
+        return index < hidden.size() ? hidden.reveal(index) : faceUp(index - hidden.size());
+    }
+    inline Card top() const {
+        if(empty()) {
+            return Card::EMPTY;
+        } else {
+            return (*this)[size() - 1];
+        }
+    }
+    inline Card bottom() const {
+        if(empty()) {
+            return Card::EMPTY;
+        } else {
+            return (*this)[0];
+        }
+    }
+    /* turns the topmost face-down card over if there are no face-up cards left */
+    inline Card revealTop() {
+        if(runLength == 0 && !hidden.empty()) {
+            runBase = hidden.revealTop();
+            runLength = 1;
+            runSuits = std::enum_value(runBase.getSuit()) >> 1;
+            hidden = hidden.removeTop();
+        }
+        return top();
+    }
+    TableauPile addTop(Card newCard) const {
+        assert(newCard.isKnown());
+        assert(runLength > 0 || hidden.empty());
+        TableauPile ret(*this);
+        if(runLength == 0) {
+            ret.runBase = newCard;
+            ret.runSuits = 0;
+        } else {
+            assert(std::enum_value(newCard.getValue()) + runLength == std::enum_value(runBase.getValue()));
+            assert(((std::enum_value(newCard.getSuit()) ^ std::enum_value(runBase.getSuit()) ^ runLength) & 1) == 0);
+        }
+        ret.runSuits |= (std::enum_value(newCard.getSuit()) >> 1) << runLength;
+        ++ret.runLength;
+        return ret;
+    }
+    /* moves the top `numCards` face-up cards of `copyFrom` onto this pile */
+    TableauPile addTop(const TableauPile& copyFrom, size_t numCards) const {
+        assert(numCards <= copyFrom.runLength);
+        assert(runLength > 0 || hidden.empty());
+        const size_t first = copyFrom.runLength - numCards;
+        TableauPile ret(*this);
+        if(numCards == 0) {
+            return ret;
+        } else if(runLength == 0) {
+            ret.runBase = copyFrom.faceUp(first);
+            ret.runSuits = 0;
+        } else {
+            assert(std::enum_value(copyFrom.faceUp(first).getValue()) + runLength == std::enum_value(runBase.getValue()));
+        }
+        ret.runSuits |= (copyFrom.runSuits >> first) << runLength;
+        ret.runLength += numCards;
+        return ret;
+    }
+    /* removes face-up cards only; call revealTop() afterward to turn over the next face-down card */
+    TableauPile removeTop(size_t numToRemove = 1) const {
+        if(numToRemove > runLength) {
+            numToRemove = runLength;
+        }
+        TableauPile ret(*this);
+        ret.runLength -= numToRemove;
+        ret.runSuits &= (1u << ret.runLength) - 1;
+        return ret;
+    }
+    /* orders piles by size, then number of face-down cards, then contents */
+    int compare(const TableauPile& other) const {
+        if(size() != other.size()) {
+            return size() < other.size() ? -1 : 1;
+        } else if(int c = hidden.compare(other.hidden)) {
+            return c;
+        } else if(runLength == 0) {
+            return 0;
+        } else if(runBase.getRaw() != other.runBase.getRaw()) {
+            return runBase.getRaw() < other.runBase.getRaw() ? -1 : 1;
+        } else if(runSuits != other.runSuits) {
+            return runSuits < other.runSuits ? -1 : 1;
+        }
+        return 0;
+    }
+    /* writes one byte per card, with bit 6 set on the face-down ones, and returns the end of the output */
+    uint8_t* pack(uint8_t* out) const {
+        out = hidden.pack(out);
+        for(size_t k=0; k<runLength; ++k) {
+            *out++ = faceUp(k).getRaw();
+        }
+        return out;
+    }
+    uint64_t fingerprint(uint64_t seed) const {
+        return astar::mix64(hidden.fingerprint(seed) ^ (static_cast<uint64_t>(runLength ? runBase.getRaw() : 0) << 48) ^ (static_cast<uint64_t>(runLength) << 32) ^ runSuits);
+    }
+    /* the same column with its face-down cards replaced by `cards`, from the bottom up */
+    TableauPile withHidden(const Card* cards) const {
+        TableauPile ret(*this);
+        ret.hidden = CardPile(hidden.size(), hidden.size());
+        for(size_t i=0; i<hidden.size(); ++i) {
+            ret.hidden.set(i, cards[i]);
+        }
+        return ret;
+    }
+    /* Everything a player can see of the column in one integer: the number of face-down cards and the run.
+     * If `unflipped`, the run's only card was just turned over and is counted as still face down. */
+    inline uint32_t visibleKey(bool unflipped = false) const {
+        if(unflipped) {
+            assert(runLength == 1);
+            return static_cast<uint32_t>(hidden.size() + 1) << 28;
+        }
+        return (static_cast<uint32_t>(hidden.size()) << 28) | (static_cast<uint32_t>(runLength) << 24) | (static_cast<uint32_t>(runLength ? runBase.getRaw() : 0) << 16) | runSuits;
+    }
+    inline size_t hash() const {
+        size_t h = empty() ? 0 : std::enum_value(reveal(0).getValue()) << 4 | std::enum_value(reveal(0).getSuit());
         h |= size() << 6;
         h ^= getNumHidden();
-        return h;
+        return h ^ (static_cast<size_t>(getRunBase().getRaw()) << 12);
     }
 };
 
@@ -348,6 +604,106 @@ namespace std {
     };
 }
 
+/* The stock and the waste together, as one array of cards in the order they are turned over and a cursor:
+ * the first `cursor` cards are the waste (the last of them on top) and the rest are the stock.  Turning
+ * cards over or recycling the waste only moves the cursor, and which cards can be brought to the top of
+ * the waste, in this pass or any later one, is a bit mask computed from the cursor and the talon size. */
+class Talon {
+private:
+    CardPile cards;
+    uint8_t cursor;
+    /* How many cards, from the front, have been turned over at some point.  Until the waste is recycled that
+     * can be more than the cursor, since playing from the waste moves the cursor back.  Only whether the stock
+     * is still face down (`seen < size()`) is part of the talon's identity; the count itself is bookkeeping
+     * for honest play, which must not look at cards that have never been turned over. */
+    uint8_t seen;
+    /* bits 0, step, 2 * step, ... */
+    static constexpr uint64_t stride(size_t step, size_t from = 0) {
+        return from >= 64 ? 0 : (1ULL << from) | stride(step, from + step);
+    }
+public:
+    Talon() : cursor(0), seen(0) {}
+    Talon(const CardPile& cards, size_t cursor, size_t seen) : cards(cards), cursor(cursor), seen(std::max(cursor, seen)) {
+        assert(cursor <= cards.size() && seen <= cards.size());
+        assert(cards.getNumHidden() == 0);
+    }
+    /* if the stock is still face down, only the cards up to the cursor have been seen */
+    Talon(const CardPile& cards, size_t cursor, bool stockHidden) : Talon(cards, cursor, stockHidden ? cursor : cards.size()) {}
+    inline bool operator==(const Talon& other) const { return cursor == other.cursor && isStockHidden() == other.isStockHidden() && cards == other.cards; }
+    inline bool operator!=(const Talon& other) const { return !(*this == other); }
+    inline size_t size() const { return cards.size(); }
+    inline bool empty() const { return cards.empty(); }
+    inline size_t getCursor() const { return cursor; }
+    inline size_t getWasteSize() const { return cursor; }
+    inline size_t getStockSize() const { return cards.size() - cursor; }
+    inline bool isStockHidden() const { return seen < size(); }
+    inline size_t getNumSeen() const { return seen; }
+    /* the card at `position`, counting in the order the cards are turned over */
+    inline Card reveal(size_t position) const { return cards.reveal(position); }
+    inline Card wasteTop() const { return cursor ? cards.reveal(cursor - 1) : Card::EMPTY; }
+    inline Talon draw(size_t numCards) const {
+        return Talon(cards, std::min(cursor + numCards, size()), static_cast<size_t>(seen));
+    }
+    /* turns the waste back over into the stock and draws `numCards` again */
+    inline Talon recycle(size_t numCards) const {
+        return Talon(cards, std::min(numCards, size()), size());
+    }
+    /* plays the card at `position` after bringing it to the top of the waste, recycling the waste first if `recycled` */
+    inline Talon remove(size_t position, bool recycled) const {
+        return Talon(cards.remove(position), position, recycled ? size() - 1 : std::max<size_t>(seen, position + 1) - 1);
+    }
+    /* The positions that can be brought to the top of the waste by drawing DRAW at a time without recycling:
+     * the current top, every DRAW-th card after it, and the last card (turned over by a short draw). */
+    template <size_t DRAW>
+    inline uint64_t reachableThisPass() const {
+        if(cursor == 0) {
+            return reachableAfterRecycle<DRAW>();
+        }
+        return ((stride(DRAW) << (cursor - 1)) & ((1ULL << size()) - 1)) | (cursor < size() ? 1ULL << (size() - 1) : 0);
+    }
+    /* the positions that can be brought to the top of the waste in any later pass */
+    template <size_t DRAW>
+    inline uint64_t reachableAfterRecycle() const {
+        return empty() ? 0 : ((stride(DRAW) << (DRAW - 1)) & ((1ULL << size()) - 1)) | (1ULL << (size() - 1));
+    }
+    template <size_t DRAW>
+    inline uint64_t reachable(bool mayRecycle) const {
+        return reachableThisPass<DRAW>() | (mayRecycle ? reachableAfterRecycle<DRAW>() : 0);
+    }
+    /* writes one byte per card, with bit 6 set on the face-down ones, and returns the end of the output */
+    uint8_t* pack(uint8_t* out) const {
+        for(size_t i=0; i<size(); ++i) {
+            *out++ = cards.reveal(i).getRaw() | (isStockHidden() && i >= cursor ? 0x40 : 0);
+        }
+        return out;
+    }
+    uint64_t fingerprint(uint64_t seed) const {
+        return astar::mix64(cards.fingerprint(seed) ^ (static_cast<uint64_t>(cursor) << 1) ^ isStockHidden());
+    }
+    /* the same for a player who has only seen the first `numSeen` cards */
+    uint64_t fingerprint(uint64_t seed, size_t numSeen) const {
+        return astar::mix64(cards.fingerprint(seed, numSeen) ^ (static_cast<uint64_t>(cursor) << 1));
+    }
+    /* the same talon with the cards that have never been turned over replaced by `unseen`, in order */
+    Talon withUnseen(const Card* unseen) const {
+        Talon ret(*this);
+        for(size_t i=seen; i<size(); ++i) {
+            ret.cards.set(i, unseen[i - seen]);
+        }
+        return ret;
+    }
+    /* whether the first `numCards` cards are the same */
+    bool samePrefix(const Talon& other, size_t numCards) const {
+        assert(numCards <= size() && numCards <= other.size());
+        for(size_t i=0; i<numCards; ++i) {
+            if(cards.reveal(i) != other.cards.reveal(i)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
 enum class MoveType : uint8_t {
     DEAL,
     MOVE_TO_WASTE,
@@ -355,7 +711,9 @@ enum class MoveType : uint8_t {
     WASTE_TO_FOUNDATION,
     WASTE_TO_TABLEAU,
     TABLEAU_TO_FOUNDATION,
-    TABLEAU_TO_TABLEAU
+    TABLEAU_TO_TABLEAU,
+    TALON_TO_FOUNDATION,
+    TALON_TO_TABLEAU
 };
 
 typedef union {
@@ -366,6 +724,10 @@ typedef union {
         uint8_t numCards;
         uint8_t destination;
     } tableauMove;
+    struct {
+        uint8_t position;
+        uint8_t tableau;
+    } talonMove;
 } MoveData;
 
 class Move {
@@ -375,6 +737,32 @@ public:
     Move(MoveType type, MoveData data) : type(type), data(data) {}
     Move(const Move& copy) : type(copy.type), data(copy.data) {}
     Move() : Move(MoveType::DEAL, {0}) {}
+    Move& operator=(const Move& copy) = default;
+    /* packs the move into 16 bits: the type in the top four, then the destination, card count, and source
+     * (or, for a move from the talon, the destination tableau and the position in the talon) */
+    inline uint16_t pack() const {
+        if(type == MoveType::TABLEAU_TO_TABLEAU) {
+            return (std::enum_value(type) << 12) | ((data.tableauMove.destination & 0x7) << 8) | ((data.tableauMove.numCards & 0x1F) << 3) | (data.tableauMove.source & 0x7);
+        } else if(type == MoveType::TALON_TO_FOUNDATION || type == MoveType::TALON_TO_TABLEAU) {
+            return (std::enum_value(type) << 12) | ((data.talonMove.tableau & 0x7) << 8) | (data.talonMove.position & 0x3F);
+        } else {
+            return (std::enum_value(type) << 12) | (data.foundation & 0x7);
+        }
+    }
+    static Move unpack(uint16_t packed) {
+        MoveData data;
+        memset(&data, 0, sizeof(data));
+        const MoveType type = static_cast<MoveType>(packed >> 12);
+        if(type == MoveType::TALON_TO_FOUNDATION || type == MoveType::TALON_TO_TABLEAU) {
+            data.talonMove.position = packed & 0x3F;
+            data.talonMove.tableau = (packed >> 8) & 0x7;
+        } else {
+            data.tableauMove.source = packed & 0x7;
+            data.tableauMove.numCards = (packed >> 3) & 0x1F;
+            data.tableauMove.destination = (packed >> 8) & 0x7;
+        }
+        return Move(type, data);
+    }
 };
 
 class MoveToWaste : public Move {
@@ -413,28 +801,168 @@ public:
     inline uint_fast8_t getDestination() const { return data.tableauMove.destination; }
 };
 
-class GameState {
+/* plays a card from anywhere in the talon that can be brought to the top of the waste, as one move */
+class TalonToFoundation : public Move {
+public:
+    TalonToFoundation(uint_fast8_t position) : Move(MoveType::TALON_TO_FOUNDATION, { .talonMove = { .position = position, .tableau = 0 } }) {}
+    inline uint_fast8_t getPosition() const { return data.talonMove.position; }
+};
+
+class TalonToTableau : public Move {
+public:
+    TalonToTableau(uint_fast8_t position, uint_fast8_t tableau) : Move(MoveType::TALON_TO_TABLEAU, { .talonMove = { .position = position, .tableau = tableau } }) {}
+    inline uint_fast8_t getPosition() const { return data.talonMove.position; }
+    inline uint_fast8_t getTableau() const { return data.talonMove.tableau; }
+};
+
+/* Packs a sequence of digits, each with its own radix, into the smallest integer that can hold them all
+ * (stored as BYTES little-endian bytes).  Digits are grouped into 32-bit chunks within a "phase" so that
+ * only one multi-word operation is needed per chunk; a decoder must know the radices of a whole phase
+ * before reading it, which is why the phases are explicit. */
+template <size_t BYTES>
+class MixedRadixNumber {
+private:
+    static constexpr size_t LIMBS = (BYTES + 3) / 4;
+    uint32_t limbs[LIMBS];
+    uint32_t groupValue;
+    uint64_t groupRadix;
+    uint32_t groups[2 * BYTES][2];
+    size_t numGroups;
+
+    void multiplyAdd(uint32_t multiplier, uint32_t addend) {
+        uint64_t carry = addend;
+        for(size_t i=0; i<LIMBS; ++i) {
+            carry += static_cast<uint64_t>(limbs[i]) * multiplier;
+            limbs[i] = static_cast<uint32_t>(carry);
+            carry >>= 32;
+        }
+        assert(carry == 0);
+    }
+    uint32_t divide(uint32_t divisor) {
+        uint64_t remainder = 0;
+        for(size_t i=LIMBS; i-- > 0;) {
+            remainder = (remainder << 32) | limbs[i];
+            limbs[i] = static_cast<uint32_t>(remainder / divisor);
+            remainder %= divisor;
+        }
+        return static_cast<uint32_t>(remainder);
+    }
+    void closeGroup() {
+        if(groupRadix > 1) {
+            assert(numGroups < 2 * BYTES);
+            groups[numGroups][0] = groupValue;
+            groups[numGroups][1] = static_cast<uint32_t>(groupRadix);
+            ++numGroups;
+        }
+        groupValue = 0;
+        groupRadix = 1;
+    }
+public:
+    MixedRadixNumber() : limbs(), groupValue(0), groupRadix(1), numGroups(0) {}
+    MixedRadixNumber(const uint8_t* bytes) : MixedRadixNumber() {
+        for(size_t i=0; i<BYTES; ++i) {
+            limbs[i / 4] |= static_cast<uint32_t>(bytes[i]) << (8 * (i % 4));
+        }
+    }
+    void push(uint32_t digit, uint32_t radix) {
+        assert(digit < radix);
+        if(groupRadix * radix > UINT32_MAX) {
+            closeGroup();
+        }
+        groupValue += digit * static_cast<uint32_t>(groupRadix);
+        groupRadix *= radix;
+    }
+    inline void endPhase() {
+        closeGroup();
+    }
+    /* assembles the pushed digits (the first one least significant) and writes out the number */
+    void write(uint8_t* bytes) {
+        closeGroup();
+        memset(limbs, 0, sizeof(limbs));
+        for(size_t i=numGroups; i-- > 0;) {
+            multiplyAdd(groups[i][1], groups[i][0]);
+        }
+        for(size_t i=0; i<BYTES; ++i) {
+            bytes[i] = static_cast<uint8_t>(limbs[i / 4] >> (8 * (i % 4)));
+        }
+    }
+    /* reads the next phase of digits, grouped exactly as push() grouped them */
+    void read(const uint32_t* radices, size_t numDigits, uint32_t* digits) {
+        for(size_t start=0; start<numDigits;) {
+            uint64_t radix = 1;
+            size_t end = start;
+            for(; end < numDigits && radix * radices[end] <= UINT32_MAX; ++end) {
+                radix *= radices[end];
+            }
+            uint32_t value = radix > 1 ? divide(static_cast<uint32_t>(radix)) : 0;
+            for(; start < end; ++start) {
+                digits[start] = value % radices[start];
+                value /= radices[start];
+            }
+        }
+    }
+};
+
+/* The rules of a Klondike variant, fixed at compile time so that every loop over the columns has a constant
+ * trip count and the deal layout is a constant: the number of cards turned from the stock at a time, the
+ * number of passes allowed through the stock (zero for no limit), and the number of tableau columns. */
+template <unsigned DRAW_COUNT, unsigned MAX_PASSES, unsigned NUM_COLUMNS>
+struct Rules {
+    static constexpr unsigned DRAW = DRAW_COUNT;
+    static constexpr unsigned PASSES = MAX_PASSES;
+    static constexpr unsigned COLUMNS = NUM_COLUMNS;
+    /* column i is dealt i face-down cards and one face-up card; the rest of the deck is the talon, and the
+     * first DRAW cards of it start out in the waste */
+    static constexpr unsigned TABLEAU_CARDS = COLUMNS * (COLUMNS + 1) / 2;
+    static constexpr unsigned TALON_CARDS = 52 - TABLEAU_CARDS;
+    static constexpr unsigned STOCK_CARDS = TALON_CARDS - DRAW;
+    static_assert(COLUMNS >= 1 && COLUMNS <= 7, "moves and legal move masks have room for at most seven columns");
+    static_assert(DRAW >= 1 && DRAW <= TALON_CARDS, "the draw count must fit in the talon");
+    static_assert(PASSES < 256, "the pass count is stored in a byte");
+    static constexpr inline size_t dealOffset(size_t column) {
+        return column * (column + 1) / 2;
+    }
+    static constexpr inline bool canRecycle(unsigned pass) {
+        return PASSES == 0 || pass + 1 < PASSES;
+    }
+};
+
+typedef Rules<1, 0, 7> DrawOne;
+typedef Rules<3, 0, 7> DrawThree;
+typedef Rules<1, 1, 7> DrawOneSinglePass;
+typedef Rules<3, 3, 7> DrawThreeThreePasses;
+
+template <class R>
+class BasicGameState {
 private:
-    CardPile stockPile;
-    CardPile waste;
-    TableauPile tableaus[7];
+    Talon talon;
+    TableauPile tableaus[R::COLUMNS];
     CardPile foundations[4];
     Move lastMove;
+    /* the number of times the waste has been turned back over into the stock (only counted if passes are limited) */
+    uint8_t pass;
+    BasicGameState() : lastMove(), pass(0) {}
 public:
-    GameState(const Deck& deck) : stockPile(23, 23), waste(1, 0), lastMove(MoveType::DEAL, { 0 }) {
-        size_t deckOffset = 0;
-        for(size_t i=0; i<std::extent<decltype(tableaus)>::value; ++i) {
-            tableaus[i] = TableauPile(i + 1, i);
-            for(size_t j=0; j<=i; ++j) {
-                tableaus[i].set(j, deck[deckOffset++]);
+    typedef R Variant;
+    BasicGameState(const Deck& deck) : lastMove(MoveType::DEAL, { 0 }), pass(0) {
+        for(size_t i=0; i<R::COLUMNS; ++i) {
+            CardPile hidden(i, i);
+            for(size_t j=0; j<i; ++j) {
+                hidden.set(j, deck[R::dealOffset(i) + j]);
             }
+            tableaus[i] = TableauPile(hidden, deck[R::dealOffset(i) + i]);
+        }
+        /* the first DRAW cards after the tableau are turned over, and the stock is drawn from the end of the deck */
+        CardPile cards(R::TALON_CARDS, 0);
+        for(size_t i=0; i<R::DRAW; ++i) {
+            cards.set(i, deck[R::TABLEAU_CARDS + i]);
         }
-        waste.set(0, deck[deckOffset++]);
-        for(size_t i=0; i<stockPile.size(); ++i) {
-            stockPile.set(i, deck[deckOffset++]);
+        for(size_t i=0; i<R::STOCK_CARDS; ++i) {
+            cards.set(R::DRAW + i, deck[51 - i]);
         }
+        talon = Talon(cards, R::DRAW, true);
     }
-    GameState(const GameState& copy) : stockPile(copy.stockPile), waste(copy.waste), lastMove(copy.lastMove) {
+    BasicGameState(const BasicGameState& copy) : talon(copy.talon), lastMove(copy.lastMove), pass(copy.pass) {
         for(size_t i=0; i<std::extent<decltype(tableaus)>::value; ++i) {
             tableaus[i] = copy.tableaus[i];
         }
@@ -442,11 +970,8 @@ public:
             foundations[i] = copy.foundations[i];
         }
     }
-    GameState(const GameState& copy, const MoveToWaste& move) : stockPile(std::move(copy.stockPile.removeTop())), waste(std::move(copy.waste.addTop(copy.stockPile.revealTop()))), lastMove(move) {
-        assert(!copy.stockPile.empty());
-        assert(stockPile.size() == copy.stockPile.size() - 1);
-        assert(waste.size() == copy.waste.size() + 1);
-        assert(waste.top() == copy.stockPile.revealTop());
+    BasicGameState(const BasicGameState& copy, const MoveToWaste& move) : talon(copy.talon.draw(R::DRAW)), lastMove(move), pass(copy.pass) {
+        assert(copy.talon.getStockSize() > 0);
         for(size_t i=0; i<std::extent<decltype(tableaus)>::value; ++i) {
             tableaus[i] = copy.tableaus[i];
         }
@@ -454,9 +979,8 @@ public:
             foundations[i] = copy.foundations[i];
         }
     }
-    GameState(const GameState& copy, const MakeNewStock& move) : stockPile(copy.getWaste().flip().removeTop()), waste(1, 0), lastMove(move) {
-        assert(copy.stockPile.empty() && copy.waste.size() > 1);
-        waste.set(0, copy.getWaste().bottom());
+    BasicGameState(const BasicGameState& copy, const MakeNewStock& move) : talon(copy.talon.recycle(R::DRAW)), lastMove(move), pass(R::PASSES ? copy.pass + 1 : 0) {
+        assert(copy.talon.getStockSize() == 0 && copy.talon.getWasteSize() > R::DRAW && R::canRecycle(copy.pass));
         for(size_t i=0; i<std::extent<decltype(tableaus)>::value; ++i) {
             tableaus[i] = copy.tableaus[i];
         }
@@ -464,27 +988,27 @@ public:
             foundations[i] = copy.foundations[i];
         }
     }
-    GameState(const GameState& copy, const WasteToFoundation& move) : stockPile(copy.getStockPile()), waste(copy.waste.removeTop()), lastMove(move) {
-        assert(!copy.waste.empty());
-        assert((copy.foundations[move].empty() && copy.waste.top().getValue() == CardValue::ACE) || (!copy.foundations[move].empty() && copy.waste.top() == copy.foundations[move].top() + 1));
-        assert(std::enum_value(copy.waste.top().getSuit()) == move);
+    BasicGameState(const BasicGameState& copy, const WasteToFoundation& move) : talon(copy.talon.remove(copy.talon.getCursor() - 1, false)), lastMove(move), pass(copy.pass) {
+        assert(copy.talon.getWasteSize() > 0);
+        assert((copy.foundations[move].empty() && copy.talon.wasteTop().getValue() == CardValue::ACE) || (!copy.foundations[move].empty() && copy.talon.wasteTop() == copy.foundations[move].top() + 1));
+        assert(std::enum_value(copy.talon.wasteTop().getSuit()) == move);
         for(size_t i=0; i<std::extent<decltype(tableaus)>::value; ++i) {
             tableaus[i] = copy.tableaus[i];
         }
         for(size_t i=0; i<std::extent<decltype(foundations)>::value; ++i) {
             if(i == move) {
-                foundations[i] = copy.foundations[i].addTop(copy.waste.top());
+                foundations[i] = copy.foundations[i].addTop(copy.talon.wasteTop());
             } else {
                 foundations[i] = copy.foundations[i];
             }
         }
     }
-    GameState(const GameState& copy, const WasteToTableau& move) : stockPile(copy.getStockPile()), waste(copy.waste.removeTop()), lastMove(move) {
-        assert(!copy.waste.empty());
-        assert((copy.tableaus[move].empty() && copy.waste.top().getValue() == CardValue::KING) || (!copy.tableaus[move].empty() && (copy.waste.top() + 1).getValue() == copy.tableaus[move].top().getValue() && copy.waste.top().getColor() != copy.tableaus[move].top().getColor()));
+    BasicGameState(const BasicGameState& copy, const WasteToTableau& move) : talon(copy.talon.remove(copy.talon.getCursor() - 1, false)), lastMove(move), pass(copy.pass) {
+        assert(copy.talon.getWasteSize() > 0);
+        assert((copy.tableaus[move].empty() && copy.talon.wasteTop().getValue() == CardValue::KING) || (!copy.tableaus[move].empty() && (copy.talon.wasteTop() + 1).getValue() == copy.tableaus[move].top().getValue() && copy.talon.wasteTop().getColor() != copy.tableaus[move].top().getColor()));
         for(size_t i=0; i<std::extent<decltype(tableaus)>::value; ++i) {
             if(i == move) {
-                tableaus[i] = copy.tableaus[i].addTop(copy.waste.top());
+                tableaus[i] = copy.tableaus[i].addTop(copy.talon.wasteTop());
             } else {
                 tableaus[i] = copy.tableaus[i];
             }
@@ -493,7 +1017,7 @@ public:
             foundations[i] = copy.foundations[i];
         }        
     }
-    GameState(const GameState& copy, const TableauToFoundation& move) : stockPile(copy.getStockPile()), waste(copy.getWaste()), lastMove(move) {
+    BasicGameState(const BasicGameState& copy, const TableauToFoundation& move) : talon(copy.talon), lastMove(move), pass(copy.pass) {
         assert(!copy.tableaus[move].empty());
         Card cardToMove = copy.tableaus[move].top();
         size_t foundationId = std::enum_value(cardToMove.getSuit());
@@ -515,7 +1039,7 @@ public:
             }
         }
     }
-    GameState(const GameState& copy, const TableauToTableau& move) : stockPile(copy.getStockPile()), waste(copy.getWaste()), lastMove(move) {
+    BasicGameState(const BasicGameState& copy, const TableauToTableau& move) : talon(copy.talon), lastMove(move), pass(copy.pass) {
         assert(copy.tableaus[move.getSource()].size() >= move.getNumCards());
         assert(move.getSource() != move.getDestination());
         for(size_t i=0; i<std::extent<decltype(tableaus)>::value; ++i) {
@@ -533,140 +1057,784 @@ public:
             foundations[i] = copy.foundations[i];
         }
     }
+    BasicGameState(const BasicGameState& copy, const TalonToFoundation& move) : talon(copy.talon.remove(move.getPosition(), copy.recycles(move.getPosition()))), lastMove(move), pass(copy.pass + (R::PASSES && copy.recycles(move.getPosition()))) {
+        assert(copy.talon.reachable<R::DRAW>(R::canRecycle(copy.pass)) & (1ULL << move.getPosition()));
+        const Card cardToMove = copy.talon.reveal(move.getPosition());
+        const size_t foundationId = std::enum_value(cardToMove.getSuit());
+        assert((copy.foundations[foundationId].empty() && cardToMove.getValue() == CardValue::ACE) || (!copy.foundations[foundationId].empty() && cardToMove == copy.foundations[foundationId].top() + 1));
+        for(size_t i=0; i<std::extent<decltype(tableaus)>::value; ++i) {
+            tableaus[i] = copy.tableaus[i];
+        }
+        for(size_t i=0; i<std::extent<decltype(foundations)>::value; ++i) {
+            if(i == foundationId) {
+                foundations[i] = copy.foundations[i].addTop(cardToMove);
+            } else {
+                foundations[i] = copy.foundations[i];
+            }
+        }
+    }
+    BasicGameState(const BasicGameState& copy, const TalonToTableau& move) : talon(copy.talon.remove(move.getPosition(), copy.recycles(move.getPosition()))), lastMove(move), pass(copy.pass + (R::PASSES && copy.recycles(move.getPosition()))) {
+        assert(copy.talon.reachable<R::DRAW>(R::canRecycle(copy.pass)) & (1ULL << move.getPosition()));
+        const Card cardToMove = copy.talon.reveal(move.getPosition());
+        const TableauPile& destination = copy.tableaus[move.getTableau()];
+        assert((destination.empty() && cardToMove.getValue() == CardValue::KING) || (!destination.empty() && (cardToMove + 1).getValue() == destination.top().getValue() && cardToMove.getColor() != destination.top().getColor()));
+        for(size_t i=0; i<std::extent<decltype(tableaus)>::value; ++i) {
+            if(i == move.getTableau()) {
+                tableaus[i] = destination.addTop(cardToMove);
+            } else {
+                tableaus[i] = copy.tableaus[i];
+            }
+        }
+        for(size_t i=0; i<std::extent<decltype(foundations)>::value; ++i) {
+            foundations[i] = copy.foundations[i];
+        }
+    }
+    BasicGameState& operator=(const BasicGameState& copy) = default;
     /* TODO: Implement this move constructor when/if needed.
-    GameState(GameState&& move) : stockPile(std::move(move.stockPile)), waste(std::move(move.waste)) {
+    BasicGameState(BasicGameState&& move) : talon(std::move(move.talon)) {
     }
     */
-    GameState applyMove(const Move& move) const {
+    BasicGameState applyMove(const Move& move) const {
         switch(move.type) {
         case MoveType::DEAL:
-            return GameState(Deck());
+            return BasicGameState(Deck());
         case MoveType::MOVE_TO_WASTE:
-            return GameState(*this, MoveToWaste());
+            return BasicGameState(*this, MoveToWaste());
         case MoveType::MAKE_NEW_STOCK:
-            return GameState(*this, MakeNewStock());
+            return BasicGameState(*this, MakeNewStock());
         case MoveType::WASTE_TO_FOUNDATION:
-            return GameState(*this, WasteToFoundation(move.data.foundation));
+            return BasicGameState(*this, WasteToFoundation(move.data.foundation));
         case MoveType::WASTE_TO_TABLEAU:
-            return GameState(*this, WasteToTableau(move.data.tableau));
+            return BasicGameState(*this, WasteToTableau(move.data.tableau));
         case MoveType::TABLEAU_TO_FOUNDATION:
-            return GameState(*this, TableauToFoundation(move.data.tableau));
+            return BasicGameState(*this, TableauToFoundation(move.data.tableau));
         case MoveType::TABLEAU_TO_TABLEAU:
-            return GameState(*this, TableauToTableau(move.data.tableauMove.source, move.data.tableauMove.numCards, move.data.tableauMove.destination));
+            return BasicGameState(*this, TableauToTableau(move.data.tableauMove.source, move.data.tableauMove.numCards, move.data.tableauMove.destination));
+        case MoveType::TALON_TO_FOUNDATION:
+            return BasicGameState(*this, TalonToFoundation(move.data.talonMove.position));
+        case MoveType::TALON_TO_TABLEAU:
+            return BasicGameState(*this, TalonToTableau(move.data.talonMove.position, move.data.talonMove.tableau));
         }
+        throw std::runtime_error("Unknown move type");
+    }
+    inline const Talon& getTalon() const { return talon; }
+    /* whether bringing the card at `position` in the talon to the top of the waste means recycling the waste */
+    inline bool recycles(size_t position) const {
+        return !(talon.reachableThisPass<R::DRAW>() & (1ULL << position));
     }
-    inline const CardPile& getStockPile() const { return stockPile; }
-    inline const CardPile& getWaste() const { return waste; }
     inline const TableauPile& getTableau(uint_fast8_t index) const { return tableaus[index]; }
     inline const CardPile& getFoundation(uint_fast8_t index) const { return foundations[index]; }
     inline const CardPile& getFoundation(Suit suit) const { return foundations[std::enum_value(suit)]; }
     inline Move getLastMove() const { return lastMove; }
+    inline unsigned getPass() const { return pass; }
+    /* The same position with every card a player has not seen replaced: `hidden` gives the face-down cards of
+     * each column in turn, from the bottom up, and then the talon cards that have never been turned over. */
+    BasicGameState determinize(const Card* hidden) const {
+        BasicGameState ret(*this);
+        for(size_t i=0; i<R::COLUMNS; ++i) {
+            ret.tableaus[i] = tableaus[i].withHidden(hidden);
+            hidden += tableaus[i].getNumHidden();
+        }
+        ret.talon = talon.withUnseen(hidden);
+        return ret;
+    }
     inline bool isWin() const { return foundations[0].size() == 13 && foundations[1].size() == 13 && foundations[2].size() == 13 && foundations[3].size() == 13; }
-    std::vector<GameState> successors() const {
-        std::vector<GameState> succ;
-        if(!stockPile.empty()) {
-            /* move one card from the stock pile into the waste */
-            succ.emplace_back(*this, MoveToWaste());
-        } else if(waste.size() > 1) {
-            /* flip the waste back over to the empty stock pile, removing the top card back to the waste */
-            succ.emplace_back(*this, MakeNewStock());
-        }
-        if(!waste.empty()) {
-            Card wasteTop = waste.top();
-            size_t foundationId = std::enum_value(wasteTop.getSuit());
-            if((foundations[foundationId].empty() && wasteTop.getValue() == CardValue::ACE) || (!foundations[foundationId].empty() && wasteTop == foundations[foundationId].top() + 1)) {
-                /* we can move the top of the waste directly to a foundation */
-                succ.emplace_back(*this, WasteToFoundation(foundationId));
+    /* whether the talon is empty and every card in the tableau is face up */
+    bool isEndgame() const {
+        if(!talon.empty()) {
+            return false;
+        }
+        for(size_t i=0; i<R::COLUMNS; ++i) {
+            if(tableaus[i].getNumHidden() > 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+    /* In an endgame the lowest card not on a foundation can always be played there: only lower cards can be
+     * on top of it, and they are already home.  So playing any card that fits, over and over, wins in at most
+     * 52 moves without searching.  Returns those moves, or none if this is not an endgame (or it gets stuck,
+     * which it should not, in which case searching is the fallback). */
+    std::vector<Move> finish() const {
+        std::vector<Move> moves;
+        if(!isEndgame()) {
+            return moves;
+        }
+        BasicGameState state(*this);
+        while(!state.isWin()) {
+            size_t tableau = 0;
+            for(; tableau < R::COLUMNS; ++tableau) {
+                const Card card = state.tableaus[tableau].top();
+                if(!state.tableaus[tableau].empty() && (state.foundations[std::enum_value(card.getSuit())].empty() ? card.getValue() == CardValue::ACE : card == state.foundations[std::enum_value(card.getSuit())].top() + 1)) {
+                    break;
+                }
+            }
+            if(tableau == R::COLUMNS) {
+                moves.clear();
+                break;
+            }
+            state = BasicGameState(state, TableauToFoundation(tableau));
+            moves.push_back(state.lastMove);
+        }
+        return moves;
+    }
+    std::vector<BasicGameState> successors() const {
+        std::vector<BasicGameState> succ;
+        /* Rather than turning cards over from the stock, play any talon card that drawing (and recycling, if
+         * that is still allowed) could bring to the top of the waste, as a single move.  Drawing is never
+         * needed otherwise: every card it could expose stays reachable until a talon card is played. */
+        for(uint64_t positions = talon.reachable<R::DRAW>(R::canRecycle(pass)); positions; positions &= positions - 1) {
+            const size_t position = __builtin_ctzll(positions);
+            const bool onTop = position + 1 == talon.getCursor();
+            const Card card = talon.reveal(position);
+            const size_t foundationId = std::enum_value(card.getSuit());
+            if((foundations[foundationId].empty() && card.getValue() == CardValue::ACE) || (!foundations[foundationId].empty() && card == foundations[foundationId].top() + 1)) {
+                if(onTop) {
+                    succ.emplace_back(*this, WasteToFoundation(foundationId));
+                } else {
+                    succ.emplace_back(*this, TalonToFoundation(position));
+                }
             }
             for(size_t tableau=0; tableau < std::extent<decltype(tableaus)>::value; ++tableau) {
-                if((tableaus[tableau].empty() && wasteTop.getValue() == CardValue::KING) || (!tableaus[tableau].empty() && (wasteTop + 1).getValue() == tableaus[tableau].top().getValue() && wasteTop.getColor() != tableaus[tableau].top().getColor())) {
-                    succ.emplace_back(*this, WasteToTableau(tableau));
+                if((tableaus[tableau].empty() && card.getValue() == CardValue::KING) || (!tableaus[tableau].empty() && (card + 1).getValue() == tableaus[tableau].top().getValue() && card.getColor() != tableaus[tableau].top().getColor())) {
+                    if(onTop) {
+                        succ.emplace_back(*this, WasteToTableau(tableau));
+                    } else {
+                        succ.emplace_back(*this, TalonToTableau(position, tableau));
+                    }
                 }
             }
         }
         for(size_t tableau=0; tableau < std::extent<decltype(tableaus)>::value; ++tableau) {
-            if(!tableaus[tableau].empty()) {
+            if(tableaus[tableau].getNumFaceUp() > 0) {
                 Card cardToMove = tableaus[tableau].top();
                 size_t foundationId = std::enum_value(cardToMove.getSuit());
                 /* first, see if we can move the top card of this tableau to the top of a foundation: */
                 if((foundations[foundationId].empty() && cardToMove.getValue() == CardValue::ACE) || (!foundations[foundationId].empty() && cardToMove == (foundations[foundationId].top() + 1))) {
                     succ.emplace_back(*this, TableauToFoundation(tableau));
                 }
-                /* next, see if we can move any subset of the cards in this tableau to another tableau: */
-                for(size_t numCards = 1; numCards <= tableaus[tableau].size(); ++numCards) {
-                    Card topCard = tableaus[tableau][tableaus[tableau].size() - numCards];
-                    if(!topCard.isKnown()) {
-                        break; /* we've reached the first unknown (face-down) card */
+                /* next, see if we can move any suffix of the face-up run in this tableau to another tableau.  The run
+                 * descends one rank per card and alternates colors, so at most one suffix fits each destination: */
+                const unsigned topRank = std::enum_value(cardToMove.getValue());
+                const Card runBase = tableaus[tableau].getRunBase();
+                const unsigned baseRank = std::enum_value(runBase.getValue());
+                for(size_t destinationTableau = 0; destinationTableau < std::extent<decltype(tableaus)>::value; ++destinationTableau) {
+                    if(destinationTableau == tableau) {
+                        continue; /* we can't move cards to the same tableau! */
                     }
-                    for(size_t destinationTableau = 0; destinationTableau < std::extent<decltype(tableaus)>::value; ++destinationTableau) {
-                        if(destinationTableau == tableau) {
-                            continue; /* we can't move cards to the same tableau! */
-                        }
-                        if((tableaus[destinationTableau].empty() && topCard.getValue() == CardValue::KING) || (!tableaus[destinationTableau].empty() && (topCard + 1).getValue() == tableaus[destinationTableau].top().getValue() && topCard.getColor() != tableaus[destinationTableau].top().getColor())) {
-                            succ.emplace_back(*this, TableauToTableau(tableau, numCards, destinationTableau));
+                    const TableauPile& destination = tableaus[destinationTableau];
+                    if(destination.empty()) {
+                        if(runBase.getValue() == CardValue::KING) {
+                            succ.emplace_back(*this, TableauToTableau(tableau, tableaus[tableau].getNumFaceUp(), destinationTableau));
                         }
+                        continue;
+                    }
+                    const unsigned neededRank = std::enum_value(destination.top().getValue()) - 1;
+                    /* the card with that rank is (baseRank - neededRank) above the base, and its color alternates from there */
+                    const bool colorDiffers = ((std::enum_value(runBase.getSuit()) ^ (baseRank - neededRank) ^ std::enum_value(destination.top().getSuit())) & 1) != 0;
+                    if(neededRank >= topRank && neededRank <= baseRank && colorDiffers) {
+                        succ.emplace_back(*this, TableauToTableau(tableau, neededRank - topRank + 1, destinationTableau));
                     }
                 }
             }
         }
         return succ;
     }
-    bool operator==(const GameState& other) const {
-        for(size_t i=0; i<std::extent<decltype(foundations)>::value; ++i) {
-            if(foundations[i] != other.foundations[i]) {
-                return false;
+    /* One of two independently seeded 64-bit lanes.  The tableau columns are combined by addition, so states
+     * that differ only by the order of their columns share a fingerprint, just as they compare equal. */
+    uint64_t fingerprint(size_t lane) const {
+        static const uint64_t seeds[2][4] = {
+            { 0x243f6a8885a308d3ULL, 0x13198a2e03707344ULL, 0xa4093822299f31d0ULL, 0x082efa98ec4e6c89ULL },
+            { 0x452821e638d01377ULL, 0xbe5466cf34e90c6cULL, 0xc0ac29b7c97c50ddULL, 0x3f84d5b5b5470917ULL }
+        };
+        const uint64_t foundationSizes = foundations[0].size() | (foundations[1].size() << 8) | (foundations[2].size() << 16) | (foundations[3].size() << 24) | (static_cast<uint64_t>(pass) << 32);
+        uint64_t tableauSum = 0;
+        for(size_t i=0; i<std::extent<decltype(tableaus)>::value; ++i) {
+            tableauSum += tableaus[i].fingerprint(seeds[lane][2]);
+        }
+        return astar::mix64(talon.fingerprint(seeds[lane][0]) ^ astar::mix64(seeds[lane][1] ^ tableauSum ^ (foundationSizes * seeds[lane][3])));
+    }
+    inline astar::Fingerprint fingerprint() const {
+        return astar::Fingerprint(fingerprint(0), fingerprint(1));
+    }
+    /* A fixed-size, canonical image of the state for hash sets that store states inline: one byte per card
+     * (the talon, then the tableau columns in sorted order, with bit 6 marking face-down cards),
+     * followed by the pile sizes and the pass.  Foundations only need their sizes since their contents are implied. */
+    struct Packed {
+        uint8_t bytes[64];
+    };
+    Packed pack() const {
+        Packed packed;
+        memset(&packed, 0, sizeof(packed));
+        uint8_t order[std::extent<decltype(tableaus)>::value];
+        for(size_t i=0; i<std::extent<decltype(tableaus)>::value; ++i) {
+            size_t j = i;
+            for(; j > 0 && tableaus[order[j - 1]].compare(tableaus[i]) > 0; --j) {
+                order[j] = order[j - 1];
             }
+            order[j] = i;
         }
-        std::unordered_set<TableauPile> myTableau;
-        std::unordered_set<TableauPile> otherTableau;
+        uint8_t* out = talon.pack(packed.bytes);
         for(size_t i=0; i<std::extent<decltype(tableaus)>::value; ++i) {
-            myTableau.insert(tableaus[i]);
-            otherTableau.insert(tableaus[i]);
-            /*if(tableaus[i] != other.tableaus[i]) {
+            out = tableaus[order[i]].pack(out);
+            packed.bytes[54 + i] = tableaus[order[i]].size();
+        }
+        assert(out <= &packed.bytes[52]);
+        packed.bytes[52] = talon.size();
+        packed.bytes[53] = talon.getCursor();
+        packed.bytes[61] = foundations[0].size() | (foundations[1].size() << 4);
+        packed.bytes[62] = foundations[2].size() | (foundations[3].size() << 4);
+        packed.bytes[63] = pass;
+        return packed;
+    }
+    /* The compact serialization used for checkpoints, result databases, and anything sent between processes.
+     * Foundation sizes, face-down and face-up counts, the talon cursor, and whether the stock is still face
+     * down are followed by every card that is not implied by the rest: the talon and the
+     * face-down and deepest face-up card of each column, each as its index among the cards not placed yet.
+     * The other face-up cards only need one bit each, since a run alternates colors.  All of that is one
+     * mixed-radix number, so each state has exactly one encoding.  If `canonicalColumns` is set, the columns
+     * are sorted first so that states that only differ by column order (which compare equal) also encode
+     * identically.  Variants with more than three passes need one more byte for the pass number. */
+    static constexpr size_t ENCODED_SIZE = R::PASSES > 3 ? 37 : 36;
+    void encode(uint8_t* out, bool canonicalColumns = false) const {
+        static constexpr size_t NUM_TABLEAUS = std::extent<decltype(tableaus)>::value;
+        MixedRadixNumber<ENCODED_SIZE> number;
+        uint8_t order[NUM_TABLEAUS];
+        for(size_t i=0; i<NUM_TABLEAUS; ++i) {
+            size_t j = i;
+            /* sorting by face-down count first keeps column i from having more than i face-down cards */
+            for(; canonicalColumns && j > 0 && (tableaus[order[j - 1]].getNumHidden() > tableaus[i].getNumHidden() || (tableaus[order[j - 1]].getNumHidden() == tableaus[i].getNumHidden() && tableaus[order[j - 1]].compare(tableaus[i]) > 0)); --j) {
+                order[j] = order[j - 1];
+            }
+            order[j] = i;
+        }
+        uint64_t pool = 0;
+        for(size_t f=0; f<std::extent<decltype(foundations)>::value; ++f) {
+            number.push(foundations[f].size(), 14);
+            for(size_t rank=foundations[f].size() + 1; rank<=13; ++rank) {
+                pool |= 1ULL << Card(static_cast<CardValue>(rank), static_cast<Suit>(f)).getIndex();
+            }
+        }
+        for(size_t i=0; i<NUM_TABLEAUS; ++i) {
+            assert(tableaus[order[i]].getNumHidden() <= i);
+            number.push(tableaus[order[i]].getNumHidden(), i + 1);
+        }
+        for(size_t i=0; i<NUM_TABLEAUS; ++i) {
+            number.push(tableaus[order[i]].size() - tableaus[order[i]].getNumHidden(), 14);
+        }
+        number.endPhase();
+        number.push(talon.getCursor(), talon.size() + 1);
+        number.push(talon.isStockHidden(), 2);
+        if(R::PASSES > 1) {
+            number.push(pass, R::PASSES);
+        }
+        number.endPhase();
+        auto pushCard = [&number,&pool](Card card) {
+            const uint64_t bit = 1ULL << card.getIndex();
+            assert(pool & bit);
+            number.push(__builtin_popcountll(pool & (bit - 1)), __builtin_popcountll(pool));
+            pool &= ~bit;
+        };
+        for(size_t i=0; i<talon.size(); ++i) {
+            pushCard(talon.reveal(i));
+        }
+        for(size_t i=0; i<NUM_TABLEAUS; ++i) {
+            const TableauPile& tableau = tableaus[order[i]];
+            for(size_t j=0; j<tableau.getNumHidden() + !tableau.empty(); ++j) {
+                pushCard(tableau.reveal(j));
+            }
+        }
+        number.endPhase();
+        for(size_t i=0; i<NUM_TABLEAUS; ++i) {
+            const TableauPile& tableau = tableaus[order[i]];
+            for(size_t j=tableau.getNumHidden() + 1; j<tableau.size(); ++j) {
+                number.push(std::enum_value(tableau.reveal(j).getSuit()) >> 1, 2);
+            }
+        }
+        number.write(out);
+        /* distributed search and the self-play records rely on this, so debug builds check every encoding */
+        assert(decode(out) == *this);
+    }
+    static BasicGameState decode(const uint8_t* in) {
+        static constexpr size_t NUM_TABLEAUS = std::extent<decltype(tableaus)>::value;
+        MixedRadixNumber<ENCODED_SIZE> number(in);
+        BasicGameState state;
+        uint32_t radices[52];
+        uint32_t digits[52];
+        for(size_t f=0; f<4; ++f) {
+            radices[f] = 14;
+        }
+        for(size_t i=0; i<NUM_TABLEAUS; ++i) {
+            radices[4 + i] = i + 1;
+            radices[4 + NUM_TABLEAUS + i] = 14;
+        }
+        number.read(radices, 4 + 2 * NUM_TABLEAUS, digits);
+        uint64_t pool = 0;
+        size_t remaining = 52;
+        for(size_t f=0; f<4; ++f) {
+            state.foundations[f] = CardPile(digits[f], 0);
+            for(size_t rank=1; rank<=13; ++rank) {
+                const Card card(static_cast<CardValue>(rank), static_cast<Suit>(f));
+                if(rank <= digits[f]) {
+                    state.foundations[f].set(rank - 1, card);
+                } else {
+                    pool |= 1ULL << card.getIndex();
+                }
+            }
+            remaining -= digits[f];
+        }
+        size_t numFree = 0;
+        size_t numRunCards = 0;
+        size_t numFaceUp[NUM_TABLEAUS];
+        CardPile hidden[NUM_TABLEAUS];
+        for(size_t i=0; i<NUM_TABLEAUS; ++i) {
+            hidden[i] = CardPile(digits[4 + i], digits[4 + i]);
+            numFaceUp[i] = digits[4 + NUM_TABLEAUS + i];
+            remaining -= hidden[i].size() + numFaceUp[i];
+            numFree += hidden[i].size() + (numFaceUp[i] > 0);
+            numRunCards += numFaceUp[i] > 0 ? numFaceUp[i] - 1 : 0;
+        }
+        radices[0] = remaining + 1;
+        radices[1] = 2;
+        radices[2] = R::PASSES;
+        number.read(radices, R::PASSES > 1 ? 3 : 2, digits);
+        state.pass = R::PASSES > 1 ? digits[2] : 0;
+        const size_t cursor = digits[0];
+        const bool stockHidden = digits[1];
+        numFree += remaining;
+        for(size_t i=0; i<numFree; ++i) {
+            radices[i] = __builtin_popcountll(pool) - i;
+        }
+        number.read(radices, numFree, digits);
+        const uint32_t* digit = digits;
+        auto popCard = [&pool](uint32_t index) {
+            uint64_t candidates = pool;
+            for(; index > 0; --index) {
+                candidates &= candidates - 1;
+            }
+            const size_t cardIndex = __builtin_ctzll(candidates);
+            pool &= ~(1ULL << cardIndex);
+            return Card::fromIndex(cardIndex);
+        };
+        CardPile talonCards(remaining, 0);
+        for(size_t i=0; i<remaining; ++i) {
+            talonCards.set(i, popCard(*digit++));
+        }
+        state.talon = Talon(talonCards, cursor, stockHidden);
+        for(size_t i=0; i<NUM_TABLEAUS; ++i) {
+            for(size_t j=0; j<hidden[i].size(); ++j) {
+                hidden[i].set(j, popCard(*digit++));
+            }
+            state.tableaus[i] = numFaceUp[i] ? TableauPile(hidden[i], popCard(*digit++)) : TableauPile(hidden[i]);
+        }
+        for(size_t i=0; i<numRunCards; ++i) {
+            radices[i] = 2;
+        }
+        number.read(radices, numRunCards, digits);
+        digit = digits;
+        for(size_t i=0; i<NUM_TABLEAUS; ++i) {
+            TableauPile& tableau = state.tableaus[i];
+            for(size_t k=1; k<numFaceUp[i]; ++k) {
+                const Card previous = tableau.top();
+                const uint8_t suit = ((std::enum_value(previous.getSuit()) & 1) ^ 1) | (*digit++ << 1);
+                tableau = tableau.addTop(Card(static_cast<CardValue>(std::enum_value(previous.getValue()) - 1), static_cast<Suit>(suit)));
+            }
+        }
+        return state;
+    }
+    bool operator==(const BasicGameState& other) const {
+        for(size_t i=0; i<std::extent<decltype(foundations)>::value; ++i) {
+            if(foundations[i].size() != other.foundations[i].size()) {
                 return false;
-                }*/
+            }
         }
-        if(myTableau != otherTableau) {
+        if(pass != other.pass || talon != other.talon) {
             return false;
         }
-        return stockPile == other.stockPile && waste == other.waste;
+        /* the tableau columns are compared as a multiset, matching each of ours to an unused equal one of theirs */
+        unsigned matched = 0;
+        for(size_t i=0; i<std::extent<decltype(tableaus)>::value; ++i) {
+            size_t j = 0;
+            for(; j<std::extent<decltype(tableaus)>::value; ++j) {
+                if(!(matched & (1u << j)) && tableaus[i].compare(other.tableaus[j]) == 0) {
+                    matched |= 1u << j;
+                    break;
+                }
+            }
+            if(j == std::extent<decltype(tableaus)>::value) {
+                return false;
+            }
+        }
+        return true;
     }
 };
 
+typedef BasicGameState<DrawOne> GameState;
+
 namespace std {
-    template <> struct hash<GameState> {
-        size_t operator()(const GameState& state) const {
-            size_t h = 0;
-            h ^= state.getStockPile().hash();
-            h ^= state.getWaste().hash();
-            for(size_t i=0; i<4; ++i) {
-                h ^= state.getFoundation(i).hash();
-            }
-            for(size_t i=0; i<7; ++i) {
-                h ^= state.getTableau(i).hash();
-            }
-            return h;
+    template <class R> struct hash<BasicGameState<R>> {
+        size_t operator()(const BasicGameState<R>& state) const {
+            return state.fingerprint(0);
         }
     };
 }
 
-std::ostream& operator<<(std::ostream& stream, const GameState& state) {
-    stream << (state.getStockPile().empty() ? "--" : "[]") << " " << state.getWaste().top() << "   ";
-    for(size_t i=0; i<4; ++i) {
-        stream << " " << state.getFoundation(i).top();
+/* The game as a player who does not peek sees it.  Equality, hashing, and the packed image only use what is
+ * visible: how many cards are face down in each column but not which, and only the part of the talon that
+ * has been turned over, so positions that differ only in unseen cards are one state to the search.  Turning
+ * a card over is a chance event, so a move that does is left pending: the successor has no successors of
+ * its own and the new card is not visible until the move is actually played and resolve()d.  The real cards
+ * are still underneath, since the game has to be played out with them. */
+template <class R>
+class BasicHonestState : public BasicGameState<R> {
+private:
+    typedef BasicGameState<R> Base;
+    static constexpr uint8_t NOT_PENDING = 0xFF;
+    static constexpr uint8_t PENDING_DRAW = 0xFE;
+    /* the column whose top card was just turned over, or PENDING_DRAW if unseen cards were just drawn */
+    uint8_t pending;
+    /* how much of the talon the player has seen; a pending draw keeps the count from before it */
+    uint8_t talonSeen;
+    inline uint32_t visibleKey(size_t column) const {
+        return this->getTableau(column).visibleKey(column == pending);
     }
-    stream << std::endl << std::endl;
-    bool allEmpty = false;
-    for(size_t row=0; !allEmpty; ++row) {
-        std::stringstream ss;
-        allEmpty = true;
-        for(size_t i=0; i<7; ++i) {
-            Card c = state.getTableau(i)[row];
-            if(i > 0) {
-                ss << " ";
+    /* the visible column keys in sorted order, since columns are interchangeable */
+    void sortedKeys(uint32_t keys[R::COLUMNS]) const {
+        for(size_t i=0; i<R::COLUMNS; ++i) {
+            const uint32_t key = visibleKey(i);
+            size_t j = i;
+            for(; j > 0 && keys[j - 1] > key; --j) {
+                keys[j] = keys[j - 1];
             }
-            if(c == Card::EMPTY) {
-                ss << "  ";
+            keys[j] = key;
+        }
+    }
+public:
+    BasicHonestState(const Deck& deck) : Base(deck), pending(NOT_PENDING), talonSeen(this->getTalon().getNumSeen()) {}
+    explicit BasicHonestState(const Base& state) : Base(state), pending(NOT_PENDING), talonSeen(state.getTalon().getNumSeen()) {}
+    /* `child` is a successor of `parent`; it is pending if the move that led to it turned a card over */
+    BasicHonestState(const BasicHonestState& parent, const Base& child) : Base(child), pending(NOT_PENDING), talonSeen(child.getTalon().getNumSeen()) {
+        const Move move = child.getLastMove();
+        if(move.type == MoveType::MOVE_TO_WASTE && child.getTalon().getNumSeen() > parent.talonSeen) {
+            pending = PENDING_DRAW;
+            talonSeen = parent.talonSeen;
+        } else if(move.type == MoveType::TABLEAU_TO_FOUNDATION || move.type == MoveType::TABLEAU_TO_TABLEAU) {
+            const size_t source = move.type == MoveType::TABLEAU_TO_FOUNDATION ? move.data.tableau : move.data.tableauMove.source;
+            if(child.getTableau(source).getNumHidden() < parent.getTableau(source).getNumHidden()) {
+                pending = source;
+            }
+        }
+    }
+    inline bool isPending() const { return pending != NOT_PENDING; }
+    inline size_t getNumTalonSeen() const { return talonSeen; }
+    /* the state once the pending card has been seen */
+    inline BasicHonestState resolve() const {
+        return BasicHonestState(static_cast<const Base&>(*this));
+    }
+    BasicHonestState applyMove(const Move& move) const {
+        return BasicHonestState(*this, Base::applyMove(move));
+    }
+    std::vector<BasicHonestState> successors() const {
+        std::vector<BasicHonestState> succ;
+        if(isPending()) {
+            return succ;
+        }
+        const Talon& talon = this->getTalon();
+        for(const Base& child : Base::successors()) {
+            const Move move = child.getLastMove();
+            if(move.type == MoveType::TALON_TO_FOUNDATION || move.type == MoveType::TALON_TO_TABLEAU) {
+                /* only cards that have been seen, and recycling the waste would turn over the rest of the stock */
+                const size_t position = move.data.talonMove.position;
+                if(position >= talon.getNumSeen() || (talon.isStockHidden() && this->recycles(position))) {
+                    continue;
+                }
+            }
+            succ.push_back(BasicHonestState(*this, child));
+        }
+        if(talon.isStockHidden() && talon.getCursor() + R::DRAW > talon.getNumSeen()) {
+            /* turning over cards that have never been seen is the only reason left to draw */
+            succ.push_back(BasicHonestState(*this, Base(*this, MoveToWaste())));
+        }
+        return succ;
+    }
+    uint64_t fingerprint(size_t lane) const {
+        static const uint64_t seeds[2][3] = {
+            { 0x9216d5d98979fb1bULL, 0xd1310ba698dfb5acULL, 0x2ffd72dbd01adfb7ULL },
+            { 0xb8e1afed6a267e96ULL, 0xba7c9045f12c7f99ULL, 0x24a19947b3916cf7ULL }
+        };
+        uint64_t foundationSizes = this->getPass();
+        for(size_t i=0; i<4; ++i) {
+            foundationSizes = (foundationSizes << 8) | this->getFoundation(i).size();
+        }
+        uint64_t tableauSum = 0;
+        for(size_t i=0; i<R::COLUMNS; ++i) {
+            tableauSum += astar::mix64(visibleKey(i) ^ seeds[lane][1]);
+        }
+        return astar::mix64(this->getTalon().fingerprint(seeds[lane][0] ^ talonSeen, talonSeen) ^ astar::mix64(tableauSum ^ (foundationSizes * seeds[lane][2])));
+    }
+    inline astar::Fingerprint fingerprint() const {
+        return astar::Fingerprint(fingerprint(0), fingerprint(1));
+    }
+    /* the seen part of the talon, the sorted column keys, and then the counts */
+    struct Packed {
+        uint8_t bytes[(R::TALON_CARDS + 4 * R::COLUMNS + 6 + 7) / 8 * 8];
+    };
+    Packed pack() const {
+        Packed packed;
+        memset(&packed, 0, sizeof(packed));
+        const Talon& talon = this->getTalon();
+        uint8_t* out = packed.bytes;
+        for(size_t i=0; i<talonSeen; ++i) {
+            *out++ = talon.reveal(i).getRaw();
+        }
+        uint32_t keys[R::COLUMNS];
+        sortedKeys(keys);
+        memcpy(out, keys, sizeof(keys));
+        uint8_t* counts = &packed.bytes[sizeof(packed.bytes) - 6];
+        assert(out + sizeof(keys) <= counts);
+        counts[0] = talon.size();
+        counts[1] = talon.getCursor();
+        counts[2] = talonSeen;
+        counts[3] = this->getFoundation(0).size() | (this->getFoundation(1).size() << 4);
+        counts[4] = this->getFoundation(2).size() | (this->getFoundation(3).size() << 4);
+        counts[5] = this->getPass();
+        return packed;
+    }
+    bool operator==(const BasicHonestState& other) const {
+        for(size_t i=0; i<4; ++i) {
+            if(this->getFoundation(i).size() != other.getFoundation(i).size()) {
+                return false;
+            }
+        }
+        const Talon& talon = this->getTalon();
+        if(this->getPass() != other.getPass() || talonSeen != other.talonSeen || talon.size() != other.getTalon().size() || talon.getCursor() != other.getTalon().getCursor() || !talon.samePrefix(other.getTalon(), talonSeen)) {
+            return false;
+        }
+        uint32_t keys[R::COLUMNS];
+        uint32_t otherKeys[R::COLUMNS];
+        sortedKeys(keys);
+        other.sortedKeys(otherKeys);
+        return memcmp(keys, otherKeys, sizeof(keys)) == 0;
+    }
+};
+
+namespace std {
+    template <class R> struct hash<BasicHonestState<R>> {
+        size_t operator()(const BasicHonestState<R>& state) const {
+            return state.fingerprint(0);
+        }
+    };
+}
+
+/* SplitMix64: a tiny, fast generator for sampling, where std::mt19937_64's 2.5KB of state is a nuisance */
+class SplitMix64 {
+private:
+    uint64_t state;
+public:
+    typedef uint64_t result_type;
+    explicit SplitMix64(uint64_t seed) : state(seed) {}
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return ~static_cast<result_type>(0); }
+    inline result_type operator()() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+    /* a number in [0, n) by multiplying instead of dividing; the bias is at most n / 2^32 */
+    inline uint32_t below(uint32_t n) {
+        return static_cast<uint32_t>(((*this)() >> 32) * n >> 32);
+    }
+};
+
+/* What an honest player knows about the cards they have not seen: which cards those are, how many
+ * face-down slots each column and the talon have left, and any slots whose card has been learned
+ * (pinned) without being turned over.  Slots are numbered column by column from the bottom of each
+ * column up, then through the talon cards that have never been turned over, in the order they will be.
+ * Every consistent deal is equally likely, so sampling one is a Fisher-Yates shuffle of the cards that
+ * are not pinned into the slots that are not, which costs one random number per card. */
+template <class R>
+class BeliefState {
+private:
+    static constexpr size_t MAX_COLUMN_SLOTS = R::COLUMNS > 1 ? R::COLUMNS - 1 : 1;
+    /* bit i is set if Card::fromIndex(i) has not been seen */
+    uint64_t unseen;
+    uint8_t columnSlots[R::COLUMNS];
+    uint8_t talonSlots;
+    /* the card learned for each slot, or Card::UNKNOWN */
+    Card columnPins[R::COLUMNS][MAX_COLUMN_SLOTS];
+    Card talonPins[R::STOCK_CARDS];
+    /* the unseen cards that are not pinned, and the slot numbers they can go into */
+    Card pool[52];
+    uint8_t freeSlots[52];
+    uint8_t poolSize;
+    uint8_t numSlots;
+    inline void markSeen(Card card) {
+        assert(unseen & (1ULL << card.getIndex()));
+        unseen &= ~(1ULL << card.getIndex());
+    }
+    void rebuildPool() {
+        uint64_t pinned = 0;
+        size_t slot = 0;
+        poolSize = 0;
+        for(size_t i=0; i<R::COLUMNS; ++i) {
+            for(size_t j=0; j<columnSlots[i]; ++j, ++slot) {
+                if(columnPins[i][j].isKnown()) {
+                    pinned |= 1ULL << columnPins[i][j].getIndex();
+                } else {
+                    freeSlots[poolSize++] = slot;
+                }
+            }
+        }
+        for(size_t j=0; j<talonSlots; ++j, ++slot) {
+            if(talonPins[j].isKnown()) {
+                pinned |= 1ULL << talonPins[j].getIndex();
+            } else {
+                freeSlots[poolSize++] = slot;
+            }
+        }
+        numSlots = slot;
+        size_t numCards = 0;
+        for(uint64_t cards = unseen & ~pinned; cards; cards &= cards - 1) {
+            pool[numCards++] = Card::fromIndex(__builtin_ctzll(cards));
+        }
+        assert(numCards == poolSize && static_cast<size_t>(__builtin_popcountll(unseen)) == numSlots);
+    }
+public:
+    /* everything a player facing `state` has seen: the foundations, the face-up cards, and the turned-over talon */
+    explicit BeliefState(const BasicGameState<R>& state) : unseen((1ULL << 52) - 1), talonSlots(state.getTalon().size() - state.getTalon().getNumSeen()) {
+        for(size_t i=0; i<4; ++i) {
+            const CardPile& foundation = state.getFoundation(i);
+            for(size_t j=0; j<foundation.size(); ++j) {
+                markSeen(foundation.reveal(j));
+            }
+        }
+        for(size_t i=0; i<R::COLUMNS; ++i) {
+            const TableauPile& tableau = state.getTableau(i);
+            columnSlots[i] = tableau.getNumHidden();
+            for(size_t j=tableau.getNumHidden(); j<tableau.size(); ++j) {
+                markSeen(tableau.reveal(j));
+            }
+            std::fill(columnPins[i], columnPins[i] + MAX_COLUMN_SLOTS, Card::UNKNOWN);
+        }
+        for(size_t j=0; j<state.getTalon().getNumSeen(); ++j) {
+            markSeen(state.getTalon().reveal(j));
+        }
+        std::fill(talonPins, talonPins + R::STOCK_CARDS, Card::UNKNOWN);
+        rebuildPool();
+    }
+    inline uint64_t getUnseen() const { return unseen; }
+    inline bool isUnseen(Card card) const { return unseen & (1ULL << card.getIndex()); }
+    inline size_t getNumHidden(size_t column) const { return columnSlots[column]; }
+    inline size_t getNumTalonHidden() const { return talonSlots; }
+    inline size_t getNumSlots() const { return numSlots; }
+    /* records that the top face-down card of `column` has been turned over and is `card` */
+    void revealColumn(size_t column, Card card) {
+        assert(columnSlots[column] > 0);
+        const size_t top = --columnSlots[column];
+        assert(!columnPins[column][top].isKnown() || columnPins[column][top] == card);
+        columnPins[column][top] = Card::UNKNOWN;
+        markSeen(card);
+        rebuildPool();
+    }
+    /* records that the next talon card that had never been turned over is `card` */
+    void revealTalon(Card card) {
+        assert(talonSlots > 0);
+        assert(!talonPins[0].isKnown() || talonPins[0] == card);
+        std::copy(talonPins + 1, talonPins + talonSlots, talonPins);
+        talonPins[--talonSlots] = Card::UNKNOWN;
+        markSeen(card);
+        rebuildPool();
+    }
+    /* records that the face-down card at `depth` in `column` (counting from the bottom) is known to be `card` */
+    void pinColumn(size_t column, size_t depth, Card card) {
+        assert(depth < columnSlots[column] && isUnseen(card));
+        columnPins[column][depth] = card;
+        rebuildPool();
+    }
+    /* records that the `index`th talon card still to be turned over is known to be `card` */
+    void pinTalon(size_t index, Card card) {
+        assert(index < talonSlots && isUnseen(card));
+        talonPins[index] = card;
+        rebuildPool();
+    }
+    /* writes a uniformly random consistent assignment of the unseen cards to all getNumSlots() slots */
+    template <class Rng>
+    void sample(Rng& rng, Card* slots) const {
+        size_t slot = 0;
+        for(size_t i=0; i<R::COLUMNS; ++i) {
+            for(size_t j=0; j<columnSlots[i]; ++j) {
+                slots[slot++] = columnPins[i][j];
+            }
+        }
+        for(size_t j=0; j<talonSlots; ++j) {
+            slots[slot++] = talonPins[j];
+        }
+        Card cards[52];
+        memcpy(cards, pool, sizeof(Card) * poolSize);
+        for(size_t i=poolSize; i-- > 0;) {
+            std::swap(cards[i], cards[rng.below(i + 1)]);
+            slots[freeSlots[i]] = cards[i];
+        }
+    }
+    /* a full deal consistent with everything seen so far, with the visible cards of `state` */
+    template <class Rng>
+    BasicGameState<R> sample(const BasicGameState<R>& state, Rng& rng) const {
+        Card slots[52];
+        sample(rng, slots);
+        return state.determinize(slots);
+    }
+};
+
+/* Klondike as the expectimax search sees it: the outcomes of a move that turns a card over are found by
+ * dealing the unseen cards at random, consistently with everything seen so far, and playing the move. */
+template <class R>
+class HonestModel {
+public:
+    typedef BasicHonestState<R> State;
+    /* Half for the cards on the foundations and half for the cards that are no longer face down; short of
+     * an actual win, neither half is ever full. */
+    double evaluate(const State& state) const {
+        static constexpr double HIDDEN_AT_DEAL = R::TABLEAU_CARDS - R::COLUMNS + R::STOCK_CARDS;
+        size_t onFoundations = 0;
+        for(size_t i=0; i<4; ++i) {
+            onFoundations += state.getFoundation(i).size();
+        }
+        size_t hidden = state.getTalon().size() - state.getNumTalonSeen();
+        for(size_t i=0; i<R::COLUMNS; ++i) {
+            hidden += state.getTableau(i).getNumHidden();
+        }
+        return 0.5 * onFoundations / 52.0 + 0.5 * (1.0 - hidden / HIDDEN_AT_DEAL);
+    }
+    template <class Rng>
+    void sample(const State& parent, const State& pending, size_t n, Rng& rng, std::vector<State>& out) const {
+        const BeliefState<R> belief(parent);
+        const Move move = pending.getLastMove();
+        out.reserve(out.size() + n);
+        for(size_t i=0; i<n; ++i) {
+            out.push_back(State(belief.sample(parent, rng)).applyMove(move).resolve());
+        }
+    }
+};
+
+template <class R>
+std::ostream& operator<<(std::ostream& stream, const BasicGameState<R>& state) {
+    stream << (state.getTalon().getStockSize() == 0 ? "--" : "[]") << " " << state.getTalon().wasteTop() << "   ";
+    for(size_t i=0; i<4; ++i) {
+        stream << " " << state.getFoundation(i).top();
+    }
+    stream << std::endl << std::endl;
+    bool allEmpty = false;
+    for(size_t row=0; !allEmpty; ++row) {
+        std::stringstream ss;
+        allEmpty = true;
+        for(size_t i=0; i<R::COLUMNS; ++i) {
+            Card c = state.getTableau(i)[row];
+            if(i > 0) {
+                ss << " ";
+            }
+            if(c == Card::EMPTY) {
+                ss << "  ";
             } else {
                 allEmpty = false;
                 ss << c;
@@ -680,10 +1848,11 @@ std::ostream& operator<<(std::ostream& stream, const GameState& state) {
     return stream;
 }
 
-unsigned naiveHeuristic(const GameState& state) {
+template <class R>
+unsigned naiveHeuristic(const BasicGameState<R>& state) {
     unsigned unknownTableauCards = 0;
     unsigned numTableausWithUnknown = 0;
-    for(size_t i=0; i<7; ++i) {
+    for(size_t i=0; i<R::COLUMNS; ++i) {
         unknownTableauCards += state.getTableau(i).getNumHidden();
         if(state.getTableau(i).getNumHidden()) {
             ++numTableausWithUnknown;
@@ -693,40 +1862,1043 @@ unsigned naiveHeuristic(const GameState& state) {
     unsigned cardsRemaining = 52 - (state.getFoundation(0).size() + state.getFoundation(1).size() + state.getFoundation(2).size() + state.getFoundation(3).size());
     return cardsRemaining;// + unknownTableauCards + numTableausWithUnknown;
 #else
-    return unknownTableauCards + state.getStockPile().size() + numTableausWithUnknown + state.getWaste().size();
+    return unknownTableauCards + state.getTalon().size() + numTableausWithUnknown;
 #endif
 }
 
-int main(int argc, char** argv) {
-    Deck deck;
-    if(argc > 1) {
-        unsigned seed = atoll(argv[1]);
-        deck = Deck(seed);
+/* A fast, fixed-policy player for rollouts: no search, just the first rule that applies, in this order:
+ *
+ *     1. play a card to a foundation, from a column that would turn a card over first, then the waste;
+ *     2. move a column's whole face-up run onto another column (or a king-led run into an empty column) if
+ *        that turns a card over, from the column with the most face-down cards;
+ *     3. put a king from the waste into an empty column;
+ *     4. play the waste onto a column;
+ *     5. draw, or turn the waste back over if something has been played since it last was.
+ *
+ * The game is kept in a compact, fixed-size form with every card known (so a BeliefState sample stands in
+ * for the hidden cards of an honest game), which plays out in a few microseconds.  With an Rng, ties
+ * between columns are broken from a random column onwards instead of always from the first. */
+template <class R>
+class RolloutPlayer {
+    template <size_t, class> friend class RolloutBatch;
+    template <size_t, class> friend class StateBatch;
+    template <size_t, class> friend class GameBatch;
+public:
+    static constexpr size_t MAX_COLUMN_CARDS = R::COLUMNS - 1 + 13;
+    struct Result {
+        bool won;
+        uint8_t foundationCards;
+        uint16_t moves;
+    };
+private:
+    /* raw Card bytes, from the bottom of each column and in the order the talon is turned over */
+    uint8_t columns[R::COLUMNS][MAX_COLUMN_CARDS];
+    uint8_t columnSize[R::COLUMNS];
+    uint8_t numHidden[R::COLUMNS];
+    uint8_t talon[R::TALON_CARDS];
+    uint8_t talonSize;
+    uint8_t cursor;
+    uint8_t pass;
+    /* the rank on each foundation, by suit */
+    uint8_t foundationRank[4];
+    static inline unsigned rank(uint8_t card) { return card >> 2; }
+    static inline unsigned suit(uint8_t card) { return card & 3; }
+    /* whether `card` can go on a column whose top card is `top` (zero for an empty column) */
+    static inline bool fits(uint8_t card, uint8_t top) {
+        return top ? rank(top) == rank(card) + 1 && ((suit(top) ^ suit(card)) & 1) : rank(card) == 13;
     }
-    GameState game(deck);
-    std::cout << "Game #" << deck.getSeed() << std::endl << std::endl;
-    std::unordered_set<GameState> history;
+    inline bool toFoundation(uint8_t card) const {
+        return foundationRank[suit(card)] + 1u == rank(card);
+    }
+    inline uint8_t top(size_t column) const {
+        return columnSize[column] ? columns[column][columnSize[column] - 1] : 0;
+    }
+    inline void popTalon() {
+        --cursor;
+        memmove(&talon[cursor], &talon[cursor + 1], talonSize - cursor - 1);
+        --talonSize;
+    }
+public:
+    explicit RolloutPlayer(const Deck& deck) : talonSize(R::TALON_CARDS), cursor(R::DRAW), pass(0), foundationRank() {
+        for(size_t i=0; i<R::COLUMNS; ++i) {
+            for(size_t j=0; j<=i; ++j) {
+                columns[i][j] = deck[R::dealOffset(i) + j].getRaw();
+            }
+            columnSize[i] = i + 1;
+            numHidden[i] = i;
+        }
+        for(size_t i=0; i<R::DRAW; ++i) {
+            talon[i] = deck[R::TABLEAU_CARDS + i].getRaw();
+        }
+        for(size_t i=0; i<R::STOCK_CARDS; ++i) {
+            talon[R::DRAW + i] = deck[51 - i].getRaw();
+        }
+    }
+    explicit RolloutPlayer(const BasicGameState<R>& state) : talonSize(state.getTalon().size()), cursor(state.getTalon().getCursor()), pass(state.getPass()) {
+        for(size_t i=0; i<R::COLUMNS; ++i) {
+            const TableauPile& tableau = state.getTableau(i);
+            for(size_t j=0; j<tableau.size(); ++j) {
+                columns[i][j] = tableau.reveal(j).getRaw();
+            }
+            columnSize[i] = tableau.size();
+            numHidden[i] = tableau.getNumHidden();
+        }
+        for(size_t i=0; i<talonSize; ++i) {
+            talon[i] = state.getTalon().reveal(i).getRaw();
+        }
+        for(size_t f=0; f<4; ++f) {
+            foundationRank[f] = state.getFoundation(f).size();
+        }
+    }
+    inline unsigned getFoundationCards() const {
+        return foundationRank[0] + foundationRank[1] + foundationRank[2] + foundationRank[3];
+    }
+    /* the number of face-down tableau cards */
+    inline unsigned getNumHidden() const {
+        unsigned hidden = 0;
+        for(size_t i=0; i<R::COLUMNS; ++i) {
+            hidden += numHidden[i];
+        }
+        return hidden;
+    }
+    /* Makes `move` in place.  Only the moves a player makes by hand are supported: the talon moves that
+     * successors() makes from deeper in the talon are not. */
+    void apply(const Move& move) {
+        switch(move.type) {
+        case MoveType::MOVE_TO_WASTE:
+            cursor = std::min<unsigned>(cursor + R::DRAW, talonSize);
+            break;
+        case MoveType::MAKE_NEW_STOCK:
+            cursor = std::min(static_cast<unsigned>(R::DRAW), static_cast<unsigned>(talonSize));
+            pass += R::PASSES ? 1 : 0;
+            break;
+        case MoveType::WASTE_TO_FOUNDATION:
+            assert(cursor && toFoundation(talon[cursor - 1]));
+            ++foundationRank[suit(talon[cursor - 1])];
+            popTalon();
+            break;
+        case MoveType::WASTE_TO_TABLEAU:
+            assert(cursor && fits(talon[cursor - 1], top(move.data.tableau)));
+            columns[move.data.tableau][columnSize[move.data.tableau]++] = talon[cursor - 1];
+            popTalon();
+            break;
+        case MoveType::TABLEAU_TO_FOUNDATION: {
+            const size_t source = move.data.tableau;
+            assert(columnSize[source] && toFoundation(top(source)));
+            ++foundationRank[suit(columns[source][--columnSize[source]])];
+            numHidden[source] = std::min(numHidden[source], columnSize[source] ? static_cast<uint8_t>(columnSize[source] - 1) : static_cast<uint8_t>(0));
+            break;
+        }
+        case MoveType::TABLEAU_TO_TABLEAU: {
+            const size_t source = move.data.tableauMove.source;
+            const size_t destination = move.data.tableauMove.destination;
+            const size_t numCards = move.data.tableauMove.numCards;
+            assert(numCards <= static_cast<size_t>(columnSize[source] - numHidden[source]));
+            memcpy(&columns[destination][columnSize[destination]], &columns[source][columnSize[source] - numCards], numCards);
+            columnSize[destination] += numCards;
+            columnSize[source] -= numCards;
+            numHidden[source] = std::min(numHidden[source], columnSize[source] ? static_cast<uint8_t>(columnSize[source] - 1) : static_cast<uint8_t>(0));
+            break;
+        }
+        default:
+            throw std::runtime_error("RolloutPlayer cannot make this move");
+        }
+    }
+    /* Plays until the game is won, the rules run out of moves, or `maxMoves` moves (draws included) have been
+     * made.  If `moves` is set, the moves made are appended to it, as moves for BasicGameState::applyMove(). */
+    template <class Rng = SplitMix64>
+    Result play(unsigned maxMoves = 1000, Rng* rng = nullptr, std::vector<Move>* moves = nullptr) {
+        Result result = { false, 0, 0 };
+        /* whether anything but a draw has been made since the waste was last turned over */
+        bool progress = true;
+        for(; result.moves < maxMoves && getFoundationCards() < 52; ++result.moves) {
+            const size_t start = rng ? rng->below(R::COLUMNS) : 0;
+            Move move;
+            /* 1: foundations, preferring a column with face-down cards */
+            size_t best = R::COLUMNS;
+            for(size_t k=0; k<R::COLUMNS; ++k) {
+                const size_t c = (start + k) % R::COLUMNS;
+                if(columnSize[c] && toFoundation(top(c)) && (best == R::COLUMNS || (numHidden[c] && columnSize[c] - 1 == numHidden[c] && !(numHidden[best] && columnSize[best] - 1 == numHidden[best])))) {
+                    best = c;
+                }
+            }
+            const uint8_t waste = cursor ? talon[cursor - 1] : 0;
+            if(best < R::COLUMNS) {
+                const uint8_t card = columns[best][--columnSize[best]];
+                ++foundationRank[suit(card)];
+                numHidden[best] = std::min(numHidden[best], columnSize[best] ? static_cast<uint8_t>(columnSize[best] - 1) : static_cast<uint8_t>(0));
+                move = TableauToFoundation(best);
+            } else if(waste && toFoundation(waste)) {
+                ++foundationRank[suit(waste)];
+                popTalon();
+                move = WasteToFoundation(suit(waste));
+            } else {
+                /* 2: a whole run that uncovers a face-down card */
+                size_t source = R::COLUMNS;
+                size_t destination = R::COLUMNS;
+                for(size_t k=0; k<R::COLUMNS; ++k) {
+                    const size_t c = (start + k) % R::COLUMNS;
+                    if(!numHidden[c] || columnSize[c] == numHidden[c] || (source < R::COLUMNS && numHidden[source] >= numHidden[c])) {
+                        continue;
+                    }
+                    const uint8_t base = columns[c][numHidden[c]];
+                    for(size_t d=0; d<R::COLUMNS; ++d) {
+                        if(d != c && fits(base, top(d))) {
+                            source = c;
+                            destination = d;
+                            break;
+                        }
+                    }
+                }
+                if(source < R::COLUMNS) {
+                    const size_t numCards = columnSize[source] - numHidden[source];
+                    memcpy(&columns[destination][columnSize[destination]], &columns[source][numHidden[source]], numCards);
+                    columnSize[destination] += numCards;
+                    columnSize[source] -= numCards;
+                    --numHidden[source];
+                    move = TableauToTableau(source, numCards, destination);
+                } else {
+                    /* 3 and 4: the waste onto a column, an empty one only for a king */
+                    for(size_t k=0; waste && k<R::COLUMNS && destination == R::COLUMNS; ++k) {
+                        const size_t c = (start + k) % R::COLUMNS;
+                        if(fits(waste, top(c))) {
+                            destination = c;
+                        }
+                    }
+                    if(destination < R::COLUMNS) {
+                        columns[destination][columnSize[destination]++] = waste;
+                        popTalon();
+                        move = WasteToTableau(destination);
+                    } else if(cursor < talonSize) {
+                        /* 5: draw */
+                        cursor = std::min<unsigned>(cursor + R::DRAW, talonSize);
+                        move = MoveToWaste();
+                    } else if(progress && talonSize > R::DRAW && R::canRecycle(pass)) {
+                        cursor = R::DRAW;
+                        pass += R::PASSES ? 1 : 0;
+                        progress = false;
+                        move = MakeNewStock();
+                    } else {
+                        break;
+                    }
+                }
+            }
+            progress |= move.type != MoveType::MOVE_TO_WASTE && move.type != MoveType::MAKE_NEW_STOCK;
+            if(moves) {
+                moves->push_back(move);
+            }
+        }
+        result.foundationCards = getFoundationCards();
+        result.won = result.foundationCards == 52;
+        return result;
+    }
+};
+
+/* RolloutPlayer's rules for N games at once.  Each game is a lane, and every per-game quantity is an array
+ * over lanes (the cards as [column][height][lane] and [position][lane]), so choosing the next move in every
+ * lane is a fixed sequence of byte-wise loops over lanes that the compiler turns into vector instructions.
+ * To keep those loops free of gathers, the cards the rules look at (the top of each column, the bottom of
+ * its face-up run, and the top of the waste) are cached per lane and refreshed when a move changes them;
+ * making the chosen moves is then done lane by lane.  Without an Rng every lane plays exactly the game
+ * RolloutPlayer would. */
+template <size_t N = 64, class R = DrawOne>
+class RolloutBatch {
+public:
+    typedef RolloutPlayer<R> Player;
+    typedef typename Player::Result Result;
+    static constexpr size_t LANES = N;
+    static constexpr size_t NUM_TABLEAUS = R::COLUMNS;
+private:
+    enum Action : uint8_t {
+        NONE,
+        TABLEAU_TO_FOUNDATION,
+        WASTE_TO_FOUNDATION,
+        TABLEAU_TO_TABLEAU,
+        WASTE_TO_TABLEAU,
+        DRAW,
+        RECYCLE
+    };
+    static constexpr uint8_t NO_COLUMN = 0xFF;
+    uint8_t cards[NUM_TABLEAUS][Player::MAX_COLUMN_CARDS][N];
+    uint8_t columnSize[NUM_TABLEAUS][N];
+    uint8_t numHidden[NUM_TABLEAUS][N];
+    uint8_t talon[R::TALON_CARDS][N];
+    uint8_t talonSize[N];
+    uint8_t cursor[N];
+    uint8_t pass[N];
+    uint8_t foundationRank[4][N];
+    /* caches: raw cards, or zero for none */
+    uint8_t top[NUM_TABLEAUS][N];
+    uint8_t runBase[NUM_TABLEAUS][N];
+    uint8_t waste[N];
+    uint8_t progress[N];
+    uint8_t done[N];
+    uint16_t moves[N];
+    /* the moves chosen by the last decide() */
+    uint8_t action[N];
+    uint8_t source[N];
+    uint8_t destination[N];
+
+    /* these are written with bitwise operators rather than branches so that the loops calling them vectorize */
+    static inline uint8_t fits(uint8_t card, uint8_t onto) {
+        const uint8_t ontoCard = (onto != 0) & ((onto >> 2) == (card >> 2) + 1) & ((onto ^ card) & 1);
+        const uint8_t kingOntoEmpty = (onto == 0) & ((card >> 2) == 13);
+        return ontoCard | kingOntoEmpty;
+    }
+    inline uint8_t toFoundation(uint8_t card, size_t lane) const {
+        const uint8_t suit = card & 3;
+        const uint8_t rank = (static_cast<uint8_t>(-(suit == 0)) & foundationRank[0][lane])
+                | (static_cast<uint8_t>(-(suit == 1)) & foundationRank[1][lane])
+                | (static_cast<uint8_t>(-(suit == 2)) & foundationRank[2][lane])
+                | (static_cast<uint8_t>(-(suit == 3)) & foundationRank[3][lane]);
+        return (card != 0) & (rank + 1 == (card >> 2));
+    }
+    /* `condition` is zero or one */
+    static inline uint8_t select(uint8_t condition, uint8_t ifTrue, uint8_t ifFalse) {
+        return ifFalse ^ ((ifTrue ^ ifFalse) & static_cast<uint8_t>(-condition));
+    }
+    inline void refreshColumn(size_t c, size_t lane) {
+        const uint8_t size = columnSize[c][lane];
+        top[c][lane] = size ? cards[c][size - 1][lane] : 0;
+        runBase[c][lane] = size > numHidden[c][lane] ? cards[c][numHidden[c][lane]][lane] : 0;
+    }
+    inline void refreshWaste(size_t lane) {
+        waste[lane] = cursor[lane] ? talon[cursor[lane] - 1][lane] : 0;
+    }
+    inline void popWaste(size_t lane) {
+        for(size_t p=cursor[lane]; p<talonSize[lane]; ++p) {
+            talon[p - 1][lane] = talon[p][lane];
+        }
+        --cursor[lane];
+        --talonSize[lane];
+        refreshWaste(lane);
+    }
+    /* chooses the next move in every lane, with the branches of RolloutPlayer::play() as selects */
+    void decide() {
+        uint8_t bestFoundation[N];
+        uint8_t bestCode[N];
+        uint8_t bestHidden[N];
+        uint8_t wasteColumn[N];
+        for(size_t lane=0; lane<N; ++lane) {
+            bestFoundation[lane] = NO_COLUMN;
+            bestCode[lane] = 0;
+            bestHidden[lane] = 0;
+            wasteColumn[lane] = NO_COLUMN;
+            source[lane] = NO_COLUMN;
+            destination[lane] = NO_COLUMN;
+        }
+        /* backwards, so that among equals the first column wins */
+        for(size_t c=NUM_TABLEAUS; c-- > 0;) {
+            for(size_t lane=0; lane<N; ++lane) {
+                const uint8_t card = top[c][lane];
+                const uint8_t reveals = (numHidden[c][lane] != 0) & (static_cast<uint8_t>(columnSize[c][lane] - numHidden[c][lane]) == 1);
+                const uint8_t foundation = toFoundation(card, lane);
+                const uint8_t code = foundation + (foundation & reveals);
+                const uint8_t take = (code != 0) & (code >= bestCode[lane]);
+                bestFoundation[lane] = take ? c : bestFoundation[lane];
+                bestCode[lane] = take ? code : bestCode[lane];
+                const uint8_t wasteFits = (waste[lane] != 0) & fits(waste[lane], card);
+                wasteColumn[lane] = wasteFits ? c : wasteColumn[lane];
+            }
+        }
+        for(size_t c=0; c<NUM_TABLEAUS; ++c) {
+            uint8_t target[N];
+            for(size_t lane=0; lane<N; ++lane) {
+                target[lane] = NO_COLUMN;
+            }
+            for(size_t d=NUM_TABLEAUS; d-- > 0;) {
+                if(d == c) {
+                    continue;
+                }
+                for(size_t lane=0; lane<N; ++lane) {
+                    target[lane] = fits(runBase[c][lane], top[d][lane]) ? d : target[lane];
+                }
+            }
+            for(size_t lane=0; lane<N; ++lane) {
+                const uint8_t hidden = numHidden[c][lane];
+                const uint8_t take = (hidden > bestHidden[lane]) & (columnSize[c][lane] > hidden) & (target[lane] != NO_COLUMN);
+                source[lane] = take ? c : source[lane];
+                destination[lane] = take ? target[lane] : destination[lane];
+                bestHidden[lane] = take ? hidden : bestHidden[lane];
+            }
+        }
+        for(size_t lane=0; lane<N; ++lane) {
+            const uint8_t wasteToFoundation = toFoundation(waste[lane], lane);
+            const uint8_t canRecycle = progress[lane] & (talonSize[lane] > R::DRAW) & ((R::PASSES == 0) | (pass[lane] + 1u < R::PASSES));
+            uint8_t chosen = select(canRecycle, RECYCLE, NONE);
+            chosen = select(cursor[lane] < talonSize[lane], DRAW, chosen);
+            chosen = select(wasteColumn[lane] != NO_COLUMN, WASTE_TO_TABLEAU, chosen);
+            chosen = select(source[lane] != NO_COLUMN, TABLEAU_TO_TABLEAU, chosen);
+            chosen = select(wasteToFoundation, WASTE_TO_FOUNDATION, chosen);
+            chosen = select(bestFoundation[lane] != NO_COLUMN, TABLEAU_TO_FOUNDATION, chosen);
+            action[lane] = select(done[lane], NONE, chosen);
+            source[lane] = select(chosen == TABLEAU_TO_FOUNDATION, bestFoundation[lane], source[lane]);
+            destination[lane] = select(chosen == WASTE_TO_TABLEAU, wasteColumn[lane], destination[lane]);
+        }
+    }
+    void apply(size_t lane) {
+        const uint8_t s = source[lane];
+        const uint8_t d = destination[lane];
+        switch(action[lane]) {
+        case NONE:
+            done[lane] = true;
+            return;
+        case TABLEAU_TO_FOUNDATION: {
+            const uint8_t size = --columnSize[s][lane];
+            ++foundationRank[top[s][lane] & 3][lane];
+            numHidden[s][lane] = std::min<uint8_t>(numHidden[s][lane], size ? size - 1 : 0);
+            refreshColumn(s, lane);
+            break;
+        }
+        case WASTE_TO_FOUNDATION:
+            ++foundationRank[waste[lane] & 3][lane];
+            popWaste(lane);
+            break;
+        case TABLEAU_TO_TABLEAU: {
+            const uint8_t first = numHidden[s][lane];
+            for(uint8_t i=first; i<columnSize[s][lane]; ++i) {
+                cards[d][columnSize[d][lane]++][lane] = cards[s][i][lane];
+            }
+            columnSize[s][lane] = first;
+            --numHidden[s][lane];
+            refreshColumn(s, lane);
+            refreshColumn(d, lane);
+            break;
+        }
+        case WASTE_TO_TABLEAU:
+            cards[d][columnSize[d][lane]++][lane] = waste[lane];
+            refreshColumn(d, lane);
+            popWaste(lane);
+            break;
+        case DRAW:
+            cursor[lane] = std::min<unsigned>(cursor[lane] + R::DRAW, talonSize[lane]);
+            refreshWaste(lane);
+            break;
+        case RECYCLE:
+            cursor[lane] = R::DRAW;
+            pass[lane] += R::PASSES ? 1 : 0;
+            progress[lane] = false;
+            refreshWaste(lane);
+            break;
+        }
+        progress[lane] |= action[lane] != DRAW && action[lane] != RECYCLE;
+        ++moves[lane];
+    }
+public:
+    RolloutBatch() : done() {
+        for(size_t lane=0; lane<N; ++lane) {
+            done[lane] = true;
+        }
+    }
+    /* starts a new game in `lane` from the player's position */
+    void reset(size_t lane, const Player& player) {
+        for(size_t c=0; c<NUM_TABLEAUS; ++c) {
+            for(size_t i=0; i<player.columnSize[c]; ++i) {
+                cards[c][i][lane] = player.columns[c][i];
+            }
+            columnSize[c][lane] = player.columnSize[c];
+            numHidden[c][lane] = player.numHidden[c];
+            refreshColumn(c, lane);
+        }
+        for(size_t p=0; p<player.talonSize; ++p) {
+            talon[p][lane] = player.talon[p];
+        }
+        talonSize[lane] = player.talonSize;
+        cursor[lane] = player.cursor;
+        pass[lane] = player.pass;
+        for(size_t f=0; f<4; ++f) {
+            foundationRank[f][lane] = player.foundationRank[f];
+        }
+        refreshWaste(lane);
+        progress[lane] = true;
+        done[lane] = player.getFoundationCards() == 52;
+        moves[lane] = 0;
+    }
+    inline void reset(size_t lane, const Deck& deck) {
+        reset(lane, Player(deck));
+    }
+    inline bool isDone(size_t lane) const { return done[lane]; }
+    /* makes one move in every lane that is not done; returns whether any lane still is not */
+    bool step(unsigned maxMoves = 1000) {
+        decide();
+        bool running = false;
+        for(size_t lane=0; lane<N; ++lane) {
+            if(!done[lane]) {
+                apply(lane);
+                done[lane] |= foundationRank[0][lane] + foundationRank[1][lane] + foundationRank[2][lane] + foundationRank[3][lane] == 52 || moves[lane] >= maxMoves;
+                running |= !done[lane];
+            }
+        }
+        return running;
+    }
+    Result getResult(size_t lane) const {
+        const uint8_t foundationCards = foundationRank[0][lane] + foundationRank[1][lane] + foundationRank[2][lane] + foundationRank[3][lane];
+        return { foundationCards == 52, foundationCards, moves[lane] };
+    }
+    /* plays every lane to the end */
+    void play(Result results[N], unsigned maxMoves = 1000) {
+        while(step(maxMoves));
+        for(size_t lane=0; lane<N; ++lane) {
+            results[lane] = getResult(lane);
+        }
+    }
+    /* Plays a stream of games, so that no lane idles while the longest game in a batch finishes:
+     * `next(lane)` should reset() the lane with a new game and return true, or return false if there are no
+     * more, and `finish(lane, result)` is called as each game ends. */
+    template <class Next, class Finish>
+    void run(Next next, Finish finish, unsigned maxMoves = 1000) {
+        size_t running = 0;
+        for(size_t lane=0; lane<N; ++lane) {
+            done[lane] = true;
+            while(done[lane] && next(lane)) {
+                if(done[lane]) {
+                    finish(lane, getResult(lane));
+                }
+            }
+            running += !done[lane];
+        }
+        while(running > 0) {
+            decide();
+            for(size_t lane=0; lane<N; ++lane) {
+                if(done[lane]) {
+                    continue;
+                }
+                apply(lane);
+                done[lane] |= foundationRank[0][lane] + foundationRank[1][lane] + foundationRank[2][lane] + foundationRank[3][lane] == 52 || moves[lane] >= maxMoves;
+                while(done[lane]) {
+                    finish(lane, getResult(lane));
+                    if(!next(lane)) {
+                        --running;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+};
+
+/* A cheap guess at how long a deal takes to play out, for ordering a batch: a linear model of a game's
+ * length in plies over how many face-down cards a few randomized RolloutPlayer games turn over, how long
+ * they last and how often they win, and how deep the aces, twos, and threes start buried in the tableau.
+ * The weights are a least-squares fit to 300 draw-one deals played by the (peeking) A* engine at 5ms a move,
+ * whose game times are almost exactly proportional to their lengths, and only mean anything for that variant
+ * and engine.  The fit is loose (a correlation of about 0.3 with the real length on deals it was not fitted
+ * to) but enough to pick out the long games.  A deal most rollouts win is "trivial": the rules alone play it
+ * out without any search, whatever the variant. */
+template <class R>
+class HardnessPredictor {
+public:
+    struct Prediction {
+        double plies;
+        bool trivial;
+    };
+private:
+    size_t rollouts;
+public:
+    explicit HardnessPredictor(size_t rollouts = 16) : rollouts(rollouts) {}
+    Prediction predict(const Deck& deck, uint64_t seed) const {
+        /* the number of cards on top of each face-down ace, two, and three */
+        unsigned lowDepth = 0;
+        for(size_t i=0; i<R::COLUMNS; ++i) {
+            for(size_t j=0; j<i; ++j) {
+                if(deck[R::dealOffset(i) + j].getValue() <= CardValue::THREE) {
+                    lowDepth += i - j;
+                }
+            }
+        }
+        const RolloutPlayer<R> start(deck);
+        SplitMix64 rng(seed);
+        unsigned revealed = 0;
+        unsigned moves = 0;
+        unsigned won = 0;
+        for(size_t r=0; r<rollouts; ++r) {
+            RolloutPlayer<R> player(start);
+            const typename RolloutPlayer<R>::Result result = player.play(1000, &rng);
+            revealed += start.getNumHidden() - player.getNumHidden();
+            moves += result.moves;
+            won += result.won;
+        }
+        const double n = static_cast<double>(std::max<size_t>(rollouts, 1));
+        const double plies = 32.3 + 3.1 * revealed / n + 1.055 * lowDepth - 0.213 * moves / n - 25.4 * won / n;
+        return { std::max(plies, 1.0), 2 * won > rollouts };
+    }
+};
+
+/* Many states stored column-wise, so that move legality, hashing, and heuristic evaluation can run across
+ * all lanes at once in loops the compiler vectorizes.  Only what those need is kept: per tableau column the
+ * top card, the rank of the deepest face-up card, and the number of face-down cards; the foundation ranks;
+ * the top of the waste; and the stock and waste sizes.  The face-up part of a column is always a descending
+ * run of alternating colors, so "which suffix can move where" is arithmetic on those ranks.  Talon moves are
+ * the ones a player makes by hand (turning cards over, or playing the top of the waste); the direct moves
+ * from deeper in the talon that successors() generates are not part of the masks. */
+template <size_t N = 16, class R = DrawOne>
+class StateBatch {
+public:
+    typedef BasicGameState<R> State;
+    static constexpr size_t LANES = N;
+    static constexpr size_t NUM_TABLEAUS = R::COLUMNS;
+    /* bit offsets of the moves in a legal move mask; tableau-to-tableau moves skip source == destination */
+    static constexpr unsigned DRAW_BIT = 0;
+    static constexpr unsigned WASTE_TO_FOUNDATION_BIT = 1;
+    static constexpr unsigned WASTE_TO_TABLEAU_BIT = 2;
+    static constexpr unsigned TABLEAU_TO_FOUNDATION_BIT = WASTE_TO_TABLEAU_BIT + NUM_TABLEAUS;
+    static constexpr unsigned TABLEAU_TO_TABLEAU_BIT = TABLEAU_TO_FOUNDATION_BIT + NUM_TABLEAUS;
+    static constexpr unsigned NUM_MOVE_BITS = TABLEAU_TO_TABLEAU_BIT + NUM_TABLEAUS * (NUM_TABLEAUS - 1);
+    static_assert(NUM_MOVE_BITS <= 64, "legal move masks must fit in 64 bits");
+private:
+    /* ranks are 1 through 13, with 0 meaning "no card"; suits follow the Suit enum, so bit 0 is the color */
+    uint8_t topRank[NUM_TABLEAUS][N];
+    uint8_t topSuit[NUM_TABLEAUS][N];
+    uint8_t runRank[NUM_TABLEAUS][N];
+    uint8_t numHidden[NUM_TABLEAUS][N];
+    uint8_t foundationRank[4][N];
+    uint8_t wasteRank[N];
+    uint8_t wasteSuit[N];
+    uint8_t stockSize[N];
+    uint8_t wasteSize[N];
+    uint8_t canRecycle[N];
+    size_t numLanes;
+
+    static inline unsigned tableauMoveBit(size_t source, size_t destination) {
+        return TABLEAU_TO_TABLEAU_BIT + source * (NUM_TABLEAUS - 1) + (destination < source ? destination : destination - 1);
+    }
+public:
+    StateBatch() : topRank(), topSuit(), runRank(), numHidden(), foundationRank(), wasteRank(), wasteSuit(), stockSize(), wasteSize(), canRecycle(), numLanes(0) {}
+    inline size_t size() const { return numLanes; }
+    inline bool full() const { return numLanes == N; }
+    inline void clear() { numLanes = 0; }
+    void set(size_t lane, const State& state) {
+        for(size_t t=0; t<NUM_TABLEAUS; ++t) {
+            const TableauPile& tableau = state.getTableau(t);
+            const Card top = tableau.top();
+            topRank[t][lane] = tableau.empty() ? 0 : std::enum_value(top.getValue());
+            topSuit[t][lane] = tableau.empty() ? 0 : std::enum_value(top.getSuit());
+            runRank[t][lane] = tableau.empty() ? 0 : std::enum_value(tableau[tableau.getNumHidden()].getValue());
+            numHidden[t][lane] = tableau.getNumHidden();
+        }
+        for(size_t f=0; f<4; ++f) {
+            foundationRank[f][lane] = state.getFoundation(f).size();
+        }
+        const Talon& talon = state.getTalon();
+        const Card wasteTop = talon.wasteTop();
+        wasteRank[lane] = talon.getWasteSize() == 0 ? 0 : std::enum_value(wasteTop.getValue());
+        wasteSuit[lane] = talon.getWasteSize() == 0 ? 0 : std::enum_value(wasteTop.getSuit());
+        stockSize[lane] = talon.getStockSize();
+        wasteSize[lane] = talon.getWasteSize();
+        canRecycle[lane] = R::canRecycle(state.getPass());
+        if(lane >= numLanes) {
+            numLanes = lane + 1;
+        }
+    }
+    /* the same for a game in RolloutPlayer's form, which is all that GameBatch keeps */
+    void set(size_t lane, const RolloutPlayer<R>& game) {
+        for(size_t t=0; t<NUM_TABLEAUS; ++t) {
+            const uint8_t size = game.columnSize[t];
+            const uint8_t top = size ? game.columns[t][size - 1] : 0;
+            topRank[t][lane] = top >> 2;
+            topSuit[t][lane] = top & 3;
+            runRank[t][lane] = size ? game.columns[t][game.numHidden[t]] >> 2 : 0;
+            numHidden[t][lane] = game.numHidden[t];
+        }
+        for(size_t f=0; f<4; ++f) {
+            foundationRank[f][lane] = game.foundationRank[f];
+        }
+        const uint8_t wasteTop = game.cursor ? game.talon[game.cursor - 1] : 0;
+        wasteRank[lane] = wasteTop >> 2;
+        wasteSuit[lane] = wasteTop & 3;
+        stockSize[lane] = game.talonSize - game.cursor;
+        wasteSize[lane] = game.cursor;
+        canRecycle[lane] = R::canRecycle(game.pass);
+        if(lane >= numLanes) {
+            numLanes = lane + 1;
+        }
+    }
+    inline size_t push(const State& state) {
+        assert(!full());
+        set(numLanes, state);
+        return numLanes - 1;
+    }
+    /* one mask per lane with a bit set for every legal move; unused lanes are left with whatever they last held */
+    void legalMoves(uint64_t masks[N]) const {
+        uint8_t wasteFoundation[N];
+        for(size_t lane=0; lane<N; ++lane) {
+            masks[lane] = (stockSize[lane] > 0) | ((wasteSize[lane] > R::DRAW) & canRecycle[lane]);
+            /* select the foundation of the waste card's suit without a gather */
+            wasteFoundation[lane] = (wasteSuit[lane] == 0) * foundationRank[0][lane] + (wasteSuit[lane] == 1) * foundationRank[1][lane] + (wasteSuit[lane] == 2) * foundationRank[2][lane] + (wasteSuit[lane] == 3) * foundationRank[3][lane];
+            masks[lane] |= static_cast<uint64_t>(wasteRank[lane] != 0 && wasteFoundation[lane] + 1 == wasteRank[lane]) << WASTE_TO_FOUNDATION_BIT;
+        }
+        for(size_t t=0; t<NUM_TABLEAUS; ++t) {
+            for(size_t lane=0; lane<N; ++lane) {
+                const bool ontoEmpty = topRank[t][lane] == 0 && wasteRank[lane] == 13;
+                const bool ontoCard = topRank[t][lane] != 0 && topRank[t][lane] == wasteRank[lane] + 1 && ((topSuit[t][lane] ^ wasteSuit[lane]) & 1);
+                masks[lane] |= static_cast<uint64_t>(wasteRank[lane] != 0 && (ontoEmpty || ontoCard)) << (WASTE_TO_TABLEAU_BIT + t);
+                const uint8_t suit = topSuit[t][lane];
+                const uint8_t foundation = (suit == 0) * foundationRank[0][lane] + (suit == 1) * foundationRank[1][lane] + (suit == 2) * foundationRank[2][lane] + (suit == 3) * foundationRank[3][lane];
+                masks[lane] |= static_cast<uint64_t>(topRank[t][lane] != 0 && foundation + 1 == topRank[t][lane]) << (TABLEAU_TO_FOUNDATION_BIT + t);
+            }
+        }
+        for(size_t source=0; source<NUM_TABLEAUS; ++source) {
+            for(size_t destination=0; destination<NUM_TABLEAUS; ++destination) {
+                if(source == destination) {
+                    continue;
+                }
+                const unsigned bit = tableauMoveBit(source, destination);
+                for(size_t lane=0; lane<N; ++lane) {
+                    /* The card that would go onto the destination is one rank below its top (which wraps around to
+                     * 255 for an empty destination), if that is in our run; its color alternates with each rank. */
+                    const uint8_t needed = topRank[destination][lane] - 1;
+                    const uint8_t inRun = (topRank[source][lane] != 0) & (needed >= topRank[source][lane]) & (needed <= runRank[source][lane]);
+                    const uint8_t colorsAlternate = (topSuit[source][lane] ^ topSuit[destination][lane] ^ topRank[source][lane] ^ needed) & 1;
+                    const uint8_t kingToEmpty = (topRank[destination][lane] == 0) & (topRank[source][lane] != 0) & (runRank[source][lane] == 13);
+                    masks[lane] |= static_cast<uint64_t>((inRun & colorsAlternate) | kingToEmpty) << bit;
+                }
+            }
+        }
+    }
+    /* the move corresponding to a bit of the lane's legal move mask */
+    Move move(size_t lane, unsigned bit) const {
+        if(bit == DRAW_BIT) {
+            return stockSize[lane] > 0 ? static_cast<Move>(MoveToWaste()) : static_cast<Move>(MakeNewStock());
+        } else if(bit == WASTE_TO_FOUNDATION_BIT) {
+            return WasteToFoundation(wasteSuit[lane]);
+        } else if(bit < TABLEAU_TO_FOUNDATION_BIT) {
+            return WasteToTableau(bit - WASTE_TO_TABLEAU_BIT);
+        } else if(bit < TABLEAU_TO_TABLEAU_BIT) {
+            return TableauToFoundation(bit - TABLEAU_TO_FOUNDATION_BIT);
+        }
+        const size_t source = (bit - TABLEAU_TO_TABLEAU_BIT) / (NUM_TABLEAUS - 1);
+        size_t destination = (bit - TABLEAU_TO_TABLEAU_BIT) % (NUM_TABLEAUS - 1);
+        if(destination >= source) {
+            ++destination;
+        }
+        const uint8_t bottomRank = topRank[destination][lane] ? topRank[destination][lane] - 1 : runRank[source][lane];
+        return TableauToTableau(source, bottomRank - topRank[source][lane] + 1, destination);
+    }
+    /* a 32-bit hash of each lane's batched columns (which do not include the face-down cards) */
+    void hash(uint32_t hashes[N]) const {
+        for(size_t lane=0; lane<N; ++lane) {
+            hashes[lane] = 2166136261u ^ stockSize[lane] ^ (static_cast<uint32_t>(wasteSize[lane]) << 8) ^ (static_cast<uint32_t>(wasteRank[lane]) << 16) ^ (static_cast<uint32_t>(wasteSuit[lane]) << 24);
+            hashes[lane] *= 16777619u;
+        }
+        for(size_t f=0; f<4; ++f) {
+            for(size_t lane=0; lane<N; ++lane) {
+                hashes[lane] = (hashes[lane] ^ foundationRank[f][lane]) * 16777619u;
+            }
+        }
+        for(size_t t=0; t<NUM_TABLEAUS; ++t) {
+            for(size_t lane=0; lane<N; ++lane) {
+                const uint32_t column = topRank[t][lane] | (static_cast<uint32_t>(topSuit[t][lane]) << 4) | (static_cast<uint32_t>(runRank[t][lane]) << 8) | (static_cast<uint32_t>(numHidden[t][lane]) << 16);
+                hashes[lane] = (hashes[lane] ^ column) * 16777619u;
+                hashes[lane] ^= hashes[lane] >> 15;
+            }
+        }
+    }
+    /* naiveHeuristic() for every lane */
+    void heuristic(unsigned values[N]) const {
+        for(size_t lane=0; lane<N; ++lane) {
+            values[lane] = 52 - (foundationRank[0][lane] + foundationRank[1][lane] + foundationRank[2][lane] + foundationRank[3][lane]);
+        }
+    }
+};
+
+/* N games stepped in lockstep, for generating training data for move-selection models.  Every call reads
+ * from and writes to caller-provided arrays with one row per lane.  Each lane's game is kept in RolloutPlayer's
+ * fixed-size form and moves are made on it in place, so step() allocates nothing (reset() still shuffles a
+ * Deck).  The action space is the legal move mask of StateBatch (drawing,
+ * playing the top of the waste, and moves from the tableau), so an action is a bit index into it.  The
+ * observation is what a player can see, in OBSERVATION_SIZE bytes:
+ *
+ *     [0, 52)                  for each card (by Card::getIndex()): 0 if it has not been seen, 1 if it is on
+ *                              a foundation, 2 + c if it is face up in column c, or TALON_CODE + p if it is
+ *                              at position p of the talon and has been seen
+ *     [52, 52 + COLUMNS)       the number of face-down cards in each column
+ *     then                     the talon size, the cursor (the waste size), and the number of passes made
+ *
+ * with the rest zero.  A lane is done when its game is won, when it has no legal moves, or after maxSteps
+ * moves; actions for lanes that are done are ignored until the next reset(). */
+template <size_t N = 16, class R = DrawOne>
+class GameBatch {
+public:
+    typedef RolloutPlayer<R> Game;
+    typedef StateBatch<N, R> Columns;
+    static constexpr size_t LANES = N;
+    static constexpr size_t NUM_ACTIONS = Columns::NUM_MOVE_BITS;
+    static constexpr uint8_t TALON_CODE = 16;
+    static constexpr size_t OBSERVATION_SIZE = (52 + R::COLUMNS + 3 + 7) / 8 * 8;
+    static_assert(TALON_CODE >= 2 + R::COLUMNS && TALON_CODE + R::TALON_CARDS <= 255, "observation codes must not overlap");
+private:
+    /* allocated once, since games have no default constructor */
+    std::vector<Game> games;
+    Columns columns;
+    uint64_t masks[N];
+    unsigned steps[N];
+    /* Talon::getNumSeen() for each lane's talon */
+    uint8_t seen[N];
+    bool done[N];
+    unsigned maxSteps;
+    void update(size_t lane) {
+        columns.set(lane, games[lane]);
+    }
+    void deal(size_t lane, unsigned seed) {
+        games[lane] = Game(Deck(seed));
+        seen[lane] = games[lane].cursor;
+        steps[lane] = 0;
+        update(lane);
+    }
+public:
+    GameBatch(unsigned maxSteps = 1000) : games(N, Game(Deck(0))), masks(), steps(), seen(), done(), maxSteps(maxSteps) {
+        for(size_t lane=0; lane<N; ++lane) {
+            done[lane] = true;
+        }
+    }
+    inline const Game& getGame(size_t lane) const { return games[lane]; }
+    inline bool isDone(size_t lane) const { return done[lane]; }
+    /* deals a new game in every lane */
+    void reset(const unsigned seeds[N]) {
+        for(size_t lane=0; lane<N; ++lane) {
+            deal(lane, seeds[lane]);
+        }
+        columns.legalMoves(masks);
+        for(size_t lane=0; lane<N; ++lane) {
+            done[lane] = masks[lane] == 0;
+        }
+    }
+    /* deals a new game in one lane, e.g., to replace one that is done */
+    void reset(size_t lane, unsigned seed) {
+        deal(lane, seed);
+        columns.legalMoves(masks);
+        done[lane] = masks[lane] == 0;
+    }
+    /* a mask of the legal actions in each lane; zero for lanes that are done */
+    void legalMoves(uint64_t out[N]) const {
+        for(size_t lane=0; lane<N; ++lane) {
+            out[lane] = done[lane] ? 0 : masks[lane];
+        }
+    }
+    void observe(uint8_t out[N][OBSERVATION_SIZE]) const {
+        for(size_t lane=0; lane<N; ++lane) {
+            const Game& game = games[lane];
+            uint8_t* obs = out[lane];
+            memset(obs, 0, OBSERVATION_SIZE);
+            /* card indices are raw cards less 4, since ranks start at 1 */
+            for(size_t f=0; f<4; ++f) {
+                for(size_t rank=1; rank<=game.foundationRank[f]; ++rank) {
+                    obs[(rank << 2 | f) - 4] = 1;
+                }
+            }
+            for(size_t c=0; c<R::COLUMNS; ++c) {
+                for(size_t i=game.numHidden[c]; i<game.columnSize[c]; ++i) {
+                    obs[game.columns[c][i] - 4] = 2 + c;
+                }
+                obs[52 + c] = game.numHidden[c];
+            }
+            for(size_t p=0; p<seen[lane]; ++p) {
+                obs[game.talon[p] - 4] = TALON_CODE + p;
+            }
+            obs[52 + R::COLUMNS] = game.talonSize;
+            obs[52 + R::COLUMNS + 1] = game.cursor;
+            obs[52 + R::COLUMNS + 2] = game.pass;
+        }
+    }
+    /* Plays actions[lane] in every lane that is not done.  The reward is the number of cards the move put
+     * onto (or, negatively, took off of) the foundations. */
+    void step(const uint8_t actions[N], float rewards[N], uint8_t isDone[N]) {
+        for(size_t lane=0; lane<N; ++lane) {
+            rewards[lane] = 0.0f;
+            if(done[lane]) {
+                continue;
+            }
+            assert(actions[lane] < NUM_ACTIONS && (masks[lane] & (1ULL << actions[lane])));
+            Game& game = games[lane];
+            const Move move = columns.move(lane, actions[lane]);
+            const unsigned before = game.getFoundationCards();
+            game.apply(move);
+            rewards[lane] = static_cast<float>(game.getFoundationCards()) - before;
+            /* as Talon keeps it: drawing can only turn over more cards, recycling shows all of them, and playing
+             * the top of the waste takes one seen card out of the talon */
+            if(move.type == MoveType::MOVE_TO_WASTE) {
+                seen[lane] = std::max(seen[lane], game.cursor);
+            } else if(move.type == MoveType::MAKE_NEW_STOCK) {
+                seen[lane] = game.talonSize;
+            } else if(move.type == MoveType::WASTE_TO_FOUNDATION || move.type == MoveType::WASTE_TO_TABLEAU) {
+                --seen[lane];
+            }
+            ++steps[lane];
+            update(lane);
+        }
+        columns.legalMoves(masks);
+        for(size_t lane=0; lane<N; ++lane) {
+            done[lane] = done[lane] || games[lane].getFoundationCards() == 52 || masks[lane] == 0 || steps[lane] >= maxSteps;
+            isDone[lane] = done[lane];
+        }
+    }
+};
+
+/* A lock-free single-producer, single-consumer queue of fixed-size slots, laid out so that it can live in
+ * memory shared between processes: it is constructed in place, holds no pointers, and the two counters are
+ * lock-free (and therefore address-free) atomics on cache lines of their own.  The producer fills the slot
+ * claim() returns and then publish()es it; the consumer reads the slot peek() returns and then release()s it.
+ * Slots are handed over in place, so nothing is copied. */
+template <class T, size_t SLOTS>
+class SpscRing {
+private:
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the ring's counters must be lock-free to be shared between processes");
+    alignas(64) std::atomic<uint64_t> written;
+    alignas(64) std::atomic<uint64_t> read;
+    alignas(64) T slots[SLOTS];
+public:
+    SpscRing() : written(0), read(0) {}
+    /* the next slot to fill, or null if the consumer has not released it yet */
+    T* claim() {
+        const uint64_t w = written.load(std::memory_order_relaxed);
+        return w - read.load(std::memory_order_acquire) < SLOTS ? &slots[w % SLOTS] : nullptr;
+    }
+    inline void publish() {
+        written.store(written.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+    /* the oldest published slot, or null if there is none */
+    const T* peek() const {
+        const uint64_t r = read.load(std::memory_order_relaxed);
+        return r < written.load(std::memory_order_acquire) ? &slots[r % SLOTS] : nullptr;
+    }
+    inline void release() {
+        read.store(read.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+};
+
+/* The shared-memory segment for --shm: a GameBatch publishes each step's observations, legal move masks,
+ * rewards, and done flags to one ring, and takes each step's actions from the other.  A lane that finishes
+ * is dealt a new game straight away, so its done flag comes with the first observation of the next game.
+ * The consumer maps the segment, checks the header, and sets `stop` to end the session. */
+template <size_t N, class R>
+struct SharedBatch {
+    typedef GameBatch<N, R> Batch;
+    static constexpr uint64_t MAGIC = 0x4b4c4f4e44494b45ULL;
+    static constexpr size_t SLOTS = 4;
+    struct Observation {
+        uint8_t observations[N][Batch::OBSERVATION_SIZE];
+        uint64_t legalMoves[N];
+        float rewards[N];
+        uint8_t done[N];
+        /* the number of steps before this one */
+        uint64_t step;
+    };
+    struct Action {
+        /* a bit index into the lane's legal move mask */
+        uint8_t actions[N];
+    };
+    /* written last, so a consumer that sees it sees the rest of the segment set up */
+    std::atomic<uint64_t> magic;
+    uint32_t lanes;
+    uint32_t observationSize;
+    uint32_t numActions;
+    uint32_t slots;
+    std::atomic<uint32_t> stop;
+    SpscRing<Observation, SLOTS> observations;
+    SpscRing<Action, SLOTS> actions;
+    SharedBatch() : magic(0), lanes(N), observationSize(Batch::OBSERVATION_SIZE), numActions(Batch::NUM_ACTIONS), slots(SLOTS), stop(0) {}
+    inline void ready() { magic.store(MAGIC, std::memory_order_release); }
+};
+
+template <class History>
+void printHistoryStatistics(std::ostream&, const History&) {}
+
+template <class T>
+void printHistoryStatistics(std::ostream& stream, const astar::BloomHistory<T>& history) {
+    stream << ", Pruned " << history.getNumPruned() << " (Est. " << static_cast<size_t>(history.getEstimatedFalsePrunes() + 0.5) << " Never Seen)";
+}
+
+/* the position the player faces after a move, once any card it turned over has been looked at */
+template <class R>
+inline const BasicGameState<R>& resolve(const BasicGameState<R>& state) { return state; }
+template <class R>
+inline BasicHonestState<R> resolve(const BasicHonestState<R>& state) { return state.resolve(); }
+
+/* a full deal to play rollouts from: the position itself when every card is known, or else the position with
+ * its unseen cards dealt at random */
+template <class R, class Rng>
+inline BasicGameState<R> sampleDeal(const BasicGameState<R>& state, Rng&) { return state; }
+template <class R, class Rng>
+inline BasicGameState<R> sampleDeal(const BasicHonestState<R>& state, Rng& rng) { return BeliefState<R>(state).sample(state, rng); }
+
+/* Flat Monte Carlo, for an engine that has given up on its own search: plays RolloutPlayer's rules after each
+ * successor of `game` that is not in `history`, in turn, until `deadline` (but at least once each), and returns
+ * the index of the one whose rollouts put the most cards on the foundations on average, or -1 if every successor
+ * is in `history`. */
+template <class State, class Rng>
+int rolloutChoice(const State& game, const std::unordered_set<State>& history, std::chrono::steady_clock::time_point deadline, Rng& rng) {
+    typedef typename State::Variant R;
+    const std::vector<State> successors = game.successors();
+    std::vector<size_t> candidates;
+    for(size_t i=0; i<successors.size(); ++i) {
+        if(!history.count(successors[i])) {
+            candidates.push_back(i);
+        }
+    }
+    if(candidates.empty()) {
+        return -1;
+    }
+    std::vector<size_t> cards(candidates.size(), 0);
+    do {
+        for(size_t c=0; c<candidates.size(); ++c) {
+            const BasicGameState<R> deal = sampleDeal(game, rng).applyMove(successors[candidates[c]].getLastMove());
+            cards[c] += RolloutPlayer<R>(deal).play(1000, &rng).foundationCards;
+        }
+    } while(std::chrono::steady_clock::now() < deadline);
+    return static_cast<int>(candidates[std::max_element(cards.begin(), cards.end()) - cards.begin()]);
+}
+
+/* Plays with IDA*.  If `giveUpFactor` is nonzero, an iteration projected to need more than that many times the
+ * time left is abandoned, and the rest of the time goes to rolloutChoice() instead. */
+template <class State, class History>
+void play(State game, double giveUpFactor, uint64_t seed) {
+    typedef typename State::Variant R;
+    typedef astar::AStar<State,std::function<unsigned(const State&)>,History> SearchType;
+    static constexpr unsigned MOVE_TIME = 500;
+    std::unordered_set<State> history;
+    SplitMix64 rng(seed);
 
     for(size_t move=0;;++move) {
         history.insert(game);
-        astar::IDAStar<GameState,std::function<unsigned(const GameState&)>> as(game, &naiveHeuristic, history);
+        astar::IDAStar<State,std::function<unsigned(const State&)>,History> search(game, &naiveHeuristic<R>, history);
+        search.setGiveUpFactor(giveUpFactor);
         std::cout << "\x1b[2J\x1b[H";
         std::cout << "Move #" << move << "\tHeuristic: " << naiveHeuristic(game) << std::endl << std::endl;
         std::cout << game << std::endl;
-        if(as.isDone()) {
+        if(search.isDone()) {
             break;
         }
-        if(auto result = as.solve(500, 1, [&as](const astar::SearchNode<GameState>& state, const astar::AStar<GameState,std::function<unsigned(const GameState&)>>& as, unsigned depthLimit)->bool{
+        const std::vector<Move> finish = game.finish();
+        if(!finish.empty()) {
+            game = resolve(game.applyMove(finish.front()));
+            continue;
+        }
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(MOVE_TIME);
+        if(auto result = search.solve(MOVE_TIME, 1, [&search](const astar::SearchNode<State>& state, const SearchType& as, unsigned depthLimit)->bool{
                     if((as.getNodesExpanded() - 1) % 5000 == 0) {
                         std::cout << "\x1b[2K";
                         std::cout << "\rSearching: Depth " << state.getPathCost() << ", F-Cost " << state.getFCost() << ", Queue Size " << as.getQueueSize() << ", Depth Limit " << depthLimit;// << next.getState();
+                        if(search.getBranchingFactor() > 0) {
+                            std::cout << ", Est. Remaining " << static_cast<size_t>(search.getEstimatedRemaining(as));
+                            std::cout << " (Branching " << std::fixed << std::setprecision(2) << search.getBranchingFactor() << ")";
+                        }
+                        printHistoryStatistics(std::cout, as.getHistory());
                         std::cout.flush();
                     }
                     return true;
                 })) {
             Move initialMove = *result.getInitialMove();
-            assert(initialMove.type != MoveType::DEAL);
-            game = game.applyMove(initialMove);
+            if(initialMove.type == MoveType::DEAL) {
+                /* the search never got past the current position: every move leads somewhere we have already been */
+                std::cout << "No moves left!" << std::endl;
+                break;
+            } else if(search.hasGivenUp()) {
+                const int choice = rolloutChoice(game, history, deadline, rng);
+                if(choice >= 0) {
+                    initialMove = game.successors()[choice].getLastMove();
+                }
+            }
+            game = resolve(game.applyMove(initialMove));
         } else {
             std::cout << "No solution found!" << std::endl;
             break;
@@ -736,3 +2908,975 @@ int main(int argc, char** argv) {
         std::cout << succ << std::endl;
         }*/
 }
+
+template <class State>
+int play(const Deck& deck, const std::string& historyType, double giveUpFactor) {
+    State game(deck);
+    std::cout << "Game #" << deck.getSeed() << std::endl << std::endl;
+
+    if(historyType == "exact") {
+        play<State,astar::PackedHistory<State>>(game, giveUpFactor, deck.getSeed());
+    } else if(historyType == "unordered") {
+        play<State,astar::ExactHistory<State>>(game, giveUpFactor, deck.getSeed());
+    } else if(historyType == "delta") {
+        play<State,astar::DeltaHistory<State>>(game, giveUpFactor, deck.getSeed());
+    } else if(historyType == "fingerprint") {
+        play<State,astar::FingerprintHistory<State>>(game, giveUpFactor, deck.getSeed());
+    } else if(historyType == "bloom") {
+        play<State,astar::BloomHistory<State>>(game, giveUpFactor, deck.getSeed());
+    } else {
+        std::cerr << "Unknown history type: " << historyType << " (expected one of: exact, unordered, delta, fingerprint, bloom)" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+/* plays without peeking, choosing each move by expectimax over the cards it might turn over */
+template <class R>
+int playExpectimax(const Deck& deck) {
+    typedef BasicHonestState<R> State;
+    typedef astar::Expectimax<State,HonestModel<R>,SplitMix64> SearchType;
+    State game(deck);
+    std::cout << "Game #" << deck.getSeed() << std::endl << std::endl;
+    const HonestModel<R> model;
+    SplitMix64 rng(deck.getSeed());
+    /* one search, so that the transposition table carries over from move to move */
+    SearchType search(model, rng);
+    std::unordered_set<State> history;
+
+    for(size_t move=0;;++move) {
+        history.insert(game);
+        std::cout << "\x1b[2J\x1b[H";
+        std::cout << "Move #" << move << "\tWin Estimate: " << model.evaluate(game) << std::endl << std::endl;
+        std::cout << game << std::endl;
+        if(game.isWin()) {
+            break;
+        }
+        const std::vector<Move> finish = game.finish();
+        if(!finish.empty()) {
+            game = resolve(game.applyMove(finish.front()));
+            continue;
+        }
+        /* the nodes expanded so far and by the last iteration to finish, to project the next one's size by the ratio
+         * of the last two */
+        size_t nodesBefore = search.getNodesExpanded();
+        size_t lastIteration = 0;
+        const typename SearchType::Result result = search.solve(game, std::chrono::milliseconds(500), history, [&search,&nodesBefore,&lastIteration](const typename SearchType::Result& result) {
+                const size_t iteration = search.getNodesExpanded() - nodesBefore;
+                std::cout << "\x1b[2K";
+                std::cout << "\rSearching: Depth " << result.depth << ", Expected Value " << result.value << ", Nodes Expanded " << search.getNodesExpanded();
+                if(lastIteration > 0) {
+                    std::cout << ", Est. Next Depth " << static_cast<size_t>(static_cast<double>(iteration) * iteration / lastIteration) << " Nodes";
+                }
+                std::cout.flush();
+                nodesBefore = search.getNodesExpanded();
+                lastIteration = iteration;
+            });
+        if(result.index < 0) {
+            std::cout << "No moves left!" << std::endl;
+            break;
+        }
+        game = game.applyMove(game.successors()[result.index].getLastMove()).resolve();
+    }
+    return 0;
+}
+
+/* plays without peeking, planning from one card being turned over to the next */
+template <class R>
+int playSubgoal(const Deck& deck) {
+    typedef BasicHonestState<R> State;
+    typedef astar::SubgoalPlanner<State,HonestModel<R>,SplitMix64> PlannerType;
+    State game(deck);
+    std::cout << "Game #" << deck.getSeed() << std::endl << std::endl;
+    const HonestModel<R> model;
+    SplitMix64 rng(deck.getSeed());
+    const PlannerType planner(model, rng);
+    std::unordered_set<State> history;
+
+    for(size_t move=0;;) {
+        history.insert(game);
+        const std::vector<Move> finish = game.finish();
+        typename PlannerType::Plan plan = { finish, 1.0, 0, 0, false };
+        if(finish.empty()) {
+            plan = planner.plan(game, history);
+        }
+        for(size_t i=0; i<=plan.moves.size(); ++i, ++move) {
+            std::cout << "\x1b[2J\x1b[H";
+            std::cout << "Move #" << move << "\tWin Estimate: " << model.evaluate(game) << "\tSubgoal: Move " << i << "/" << plan.moves.size() << " (Expected Value " << plan.value << ", " << plan.frontierSize << " Reveals Considered)" << std::endl << std::endl;
+            std::cout << game << std::endl;
+            if(i == plan.moves.size()) {
+                break;
+            }
+            game = resolve(game.applyMove(plan.moves[i]));
+            history.insert(game);
+        }
+        if(game.isWin()) {
+            break;
+        } else if(plan.moves.empty()) {
+            std::cout << "No moves left!" << std::endl;
+            break;
+        }
+    }
+    return 0;
+}
+
+/* One position from self-play: the full state, the legal moves, the move the engine chose and what its search
+ * found, and how the game turned out.  Records are written as they are in memory, so they are little-endian
+ * on the machines this runs on, with no padding. */
+struct SelfPlayRecord {
+    static constexpr size_t MAX_MOVES = 48;
+    /* BasicGameState::encode(), zero-padded */
+    uint8_t state[40];
+    /* Move::pack() of each legal move, in successors() order, zero-padded (zero is a deal, which is never legal) */
+    uint16_t legalMoves[MAX_MOVES];
+    uint32_t seed;
+    uint32_t nodesExpanded;
+    uint32_t microseconds;
+    /* the engine's own estimate of the position: a win probability, or the F-cost for A* */
+    float value;
+    uint16_t chosenMove;
+    uint16_t ply;
+    uint16_t gameLength;
+    uint16_t depth;
+    /* the number of legal moves, which may be more than MAX_MOVES */
+    uint8_t numLegalMoves;
+    uint8_t draw;
+    uint8_t passes;
+    uint8_t honest;
+    /* the number of cards on the foundations at the end of the game, and whether it was won */
+    uint8_t foundationCards;
+    uint8_t won;
+    uint8_t reserved[2];
+};
+static_assert(sizeof(SelfPlayRecord) == 168, "self-play records must have no padding");
+
+/* Appends records to prefix.000000.bin, prefix.000001.bin, and so on, starting a new file after every
+ * `recordsPerFile` records.  Any number of threads may write at once; each call's records stay together
+ * (apart from where a file boundary splits them). */
+class RecordWriter {
+private:
+    std::mutex mutex;
+    std::string prefix;
+    size_t recordsPerFile;
+    size_t numFiles;
+    size_t recordsInFile;
+    /* read without the lock, for progress reports */
+    std::atomic<size_t> numRecords;
+    std::ofstream file;
+    void rotate() {
+        if(file.is_open()) {
+            file.close();
+        }
+        std::ostringstream path;
+        path << prefix << "." << std::setw(6) << std::setfill('0') << numFiles++ << ".bin";
+        file.open(path.str(), std::ios::binary | std::ios::trunc);
+        if(!file) {
+            throw std::runtime_error("Unable to open " + path.str() + " for writing");
+        }
+        recordsInFile = 0;
+    }
+public:
+    RecordWriter(const std::string& prefix, size_t recordsPerFile = 1000000) : prefix(prefix), recordsPerFile(recordsPerFile), numFiles(0), recordsInFile(0), numRecords(0) {}
+    void write(const SelfPlayRecord* records, size_t count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        while(count > 0) {
+            if(!file.is_open() || recordsInFile == recordsPerFile) {
+                rotate();
+            }
+            const size_t n = std::min(count, recordsPerFile - recordsInFile);
+            file.write(reinterpret_cast<const char*>(records), sizeof(SelfPlayRecord) * n);
+            records += n;
+            count -= n;
+            recordsInFile += n;
+            numRecords += n;
+        }
+        file.flush();
+    }
+    inline size_t getNumFiles() const { return numFiles; }
+    inline size_t getNumRecords() const { return numRecords; }
+};
+
+struct SearchStatistics {
+    size_t nodesExpanded;
+    unsigned depth;
+    double value;
+};
+
+/* The engines as move choosers for self-play: the same searches as the interactive loops, without the display.
+ * choose() returns false if the engine has no move to suggest. */
+template <class State>
+class AStarChooser {
+private:
+    std::chrono::milliseconds timeLimit;
+    SplitMix64 rng;
+    double giveUpFactor;
+public:
+    typedef State StateType;
+    AStarChooser(std::chrono::milliseconds timeLimit, uint64_t seed) : timeLimit(timeLimit), rng(seed), giveUpFactor(0.0) {}
+    /* as for play(): zero (the default) never gives up */
+    inline void setGiveUpFactor(double factor) { giveUpFactor = factor; }
+    bool choose(const State& game, const std::unordered_set<State>& history, Move& move, SearchStatistics& stats) {
+        typedef typename State::Variant R;
+        typedef astar::AStar<State,std::function<unsigned(const State&)>,astar::PackedHistory<State>> SearchType;
+        astar::IDAStar<State,std::function<unsigned(const State&)>,astar::PackedHistory<State>> as(game, &naiveHeuristic<R>, history);
+        if(as.isDone()) {
+            return false;
+        }
+        as.setGiveUpFactor(giveUpFactor);
+        const auto deadline = std::chrono::steady_clock::now() + timeLimit;
+        auto result = as.solve(timeLimit, 1, [&stats](const astar::SearchNode<State>&, const SearchType&, unsigned depthLimit)->bool {
+                ++stats.nodesExpanded;
+                stats.depth = depthLimit;
+                return true;
+            });
+        if(!result || result.getInitialMove()->type == MoveType::DEAL) {
+            return false;
+        }
+        move = *result.getInitialMove();
+        stats.value = result.getFCost();
+        if(as.hasGivenUp()) {
+            const int choice = rolloutChoice(game, history, deadline, rng);
+            if(choice >= 0) {
+                move = game.successors()[choice].getLastMove();
+            }
+        }
+        return true;
+    }
+};
+
+template <class R>
+class ExpectimaxChooser {
+private:
+    typedef astar::Expectimax<BasicHonestState<R>,HonestModel<R>,SplitMix64> SearchType;
+    std::chrono::milliseconds timeLimit;
+    HonestModel<R> model;
+    SplitMix64 rng;
+    SearchType search;
+public:
+    typedef BasicHonestState<R> StateType;
+    ExpectimaxChooser(std::chrono::milliseconds timeLimit, uint64_t seed) : timeLimit(timeLimit), rng(seed), search(model, rng) {}
+    ExpectimaxChooser(const ExpectimaxChooser&) = delete;
+    bool choose(const StateType& game, const std::unordered_set<StateType>& history, Move& move, SearchStatistics& stats) {
+        const size_t nodesBefore = search.getNodesExpanded();
+        const typename SearchType::Result result = search.solve(game, timeLimit, history);
+        if(result.index < 0) {
+            return false;
+        }
+        move = game.successors()[result.index].getLastMove();
+        stats.nodesExpanded = search.getNodesExpanded() - nodesBefore;
+        stats.depth = result.depth;
+        stats.value = result.value;
+        return true;
+    }
+};
+
+/* plans from one reveal to the next, for as long as a move may take, and then plays the plan out, replanning if
+ * the game strays from it */
+template <class R>
+class SubgoalChooser {
+private:
+    typedef astar::SubgoalPlanner<BasicHonestState<R>,HonestModel<R>,SplitMix64> PlannerType;
+    std::chrono::milliseconds timeLimit;
+    HonestModel<R> model;
+    SplitMix64 rng;
+    PlannerType planner;
+    typename PlannerType::Plan plan;
+    size_t nextMove;
+    std::vector<BasicHonestState<R>> expected;
+public:
+    typedef BasicHonestState<R> StateType;
+    SubgoalChooser(std::chrono::milliseconds timeLimit, uint64_t seed) : timeLimit(timeLimit), rng(seed), planner(model, rng, 16, ~static_cast<size_t>(0)), nextMove(0) {}
+    SubgoalChooser(const SubgoalChooser&) = delete;
+    bool choose(const StateType& game, const std::unordered_set<StateType>& history, Move& move, SearchStatistics& stats) {
+        if(nextMove >= plan.moves.size() || expected.empty() || !(expected.front() == game)) {
+            plan = planner.plan(game, history, std::chrono::steady_clock::now() + timeLimit);
+            nextMove = 0;
+            expected.assign(1, game);
+        }
+        if(plan.moves.empty()) {
+            return false;
+        }
+        move = plan.moves[nextMove++];
+        expected.assign(1, game.applyMove(move));
+        stats.nodesExpanded = nextMove == 1 ? plan.statesExpanded : 0;
+        stats.depth = plan.moves.size() - nextMove + 1;
+        stats.value = plan.value;
+        return true;
+    }
+};
+
+/* plays one game with `chooser`, appending a record for every position in which a move was made */
+template <class Chooser, class Records>
+void selfPlayGame(unsigned seed, Chooser& chooser, Records& records) {
+    typedef typename Chooser::StateType State;
+    typedef typename State::Variant R;
+    static constexpr size_t MAX_PLIES = 1000;
+    State game{Deck(seed)};
+    std::unordered_set<State> history;
+    const size_t first = records.size();
+    for(size_t ply=0; ply<MAX_PLIES && !game.isWin(); ++ply) {
+        history.insert(game);
+        SelfPlayRecord record;
+        memset(&record, 0, sizeof(record));
+        game.encode(record.state);
+        const std::vector<State> successors = game.successors();
+        record.numLegalMoves = std::min<size_t>(successors.size(), 255);
+        for(size_t i=0; i<successors.size() && i<SelfPlayRecord::MAX_MOVES; ++i) {
+            record.legalMoves[i] = successors[i].getLastMove().pack();
+        }
+        SearchStatistics stats = { 0, 0, 0.0 };
+        Move move;
+        const auto startTime = std::chrono::steady_clock::now();
+        const std::vector<Move> finish = game.finish();
+        if(!finish.empty()) {
+            move = finish.front();
+            stats.value = 1.0;
+        } else if(!chooser.choose(game, history, move, stats)) {
+            break;
+        }
+        record.microseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+        record.seed = seed;
+        record.nodesExpanded = stats.nodesExpanded;
+        record.value = stats.value;
+        record.chosenMove = move.pack();
+        record.ply = ply;
+        record.depth = std::min<unsigned>(stats.depth, 0xFFFF);
+        record.draw = R::DRAW;
+        record.passes = R::PASSES;
+        record.honest = !std::is_same<State, BasicGameState<R>>::value;
+        records.push_back(record);
+        game = resolve(game.applyMove(move));
+    }
+    unsigned foundationCards = 0;
+    for(size_t i=0; i<4; ++i) {
+        foundationCards += game.getFoundation(i).size();
+    }
+    for(size_t i=first; i<records.size(); ++i) {
+        records[i].gameLength = records.size() - first;
+        records[i].foundationCards = foundationCards;
+        records[i].won = game.isWin();
+    }
+}
+
+struct Options {
+    std::string engine;
+    std::string historyType;
+    bool honest;
+    /* self-play: the number of games (zero to play one game interactively), threads, output files, and time per move */
+    size_t selfPlayGames;
+    size_t threads;
+    bool pinThreads;
+    std::string recordPrefix;
+    unsigned moveTime;
+    /* if set, serve a GameBatch to another process through this shared memory object instead of playing */
+    std::string sharedMemoryName;
+    /* if nonzero, play this many games from consecutive seeds, like self-play but without writing records */
+    size_t batchGames;
+    /* Stop a batch early once its win rate's 95% confidence interval is at most `precision` either side of the
+     * estimate, or, if `versus` is set, once a sequential test says whether these options or the same options
+     * with `versus` applied (e.g., "engine=subgoal,movetime=20") win more often.  Either is "better" if it wins at
+     * least 0.5 + `margin` of the deals that only one of them wins. */
+    double precision;
+    std::string versus;
+    double margin;
+    /* Batch and self-play games with the peeking A* engine at draw one start longest first, as HardnessPredictor
+     * guesses, if `schedule` is "longest"; otherwise, or if it is "fifo", they start in seed order.  If
+     * `quickPass` is nonzero, a batch first plays the deals predicted trivial with that fraction of the move time
+     * and plays only the ones it loses again with the full time, so a deal is won if either pass wins it. */
+    std::string schedule;
+    double quickPass;
+    /* as for play(): the A* engine gives up on an iteration projected to need more than this many times the time
+     * it has left (by default, once it is projected not to finish), and chooses its move by rollouts instead;
+     * zero never gives up */
+    double giveUpFactor;
+    /* if nonzero, play this many games from consecutive seeds with the RolloutPlayer */
+    size_t rollouts;
+    /* Distributed search: either this many local processes on consecutive ports from `port`, or one process
+     * (`workerRank`) of those in `peers`.  Process 0 gives up after `timeLimit` seconds, if it is nonzero. */
+    size_t localProcesses;
+    int workerRank;
+    std::vector<astar::Peer> peers;
+    uint16_t port;
+    unsigned timeLimit;
+};
+
+/* applies one command line option of the form --name or --name=value; returns false if it is not one */
+bool parseOption(const std::string& arg, Options& options) {
+    if(arg.compare(0, 10, "--history=") == 0) {
+        options.historyType = arg.substr(10);
+    } else if(arg.compare(0, 9, "--engine=") == 0) {
+        options.engine = arg.substr(9);
+    } else if(arg == "--honest") {
+        options.honest = true;
+    } else if(arg.compare(0, 11, "--selfplay=") == 0) {
+        options.selfPlayGames = atoll(arg.substr(11).c_str());
+    } else if(arg.compare(0, 10, "--threads=") == 0) {
+        options.threads = atoi(arg.substr(10).c_str());
+    } else if(arg == "--pin") {
+        options.pinThreads = true;
+    } else if(arg.compare(0, 8, "--batch=") == 0) {
+        options.batchGames = atoll(arg.substr(8).c_str());
+    } else if(arg.compare(0, 12, "--precision=") == 0) {
+        options.precision = atof(arg.substr(12).c_str());
+    } else if(arg.compare(0, 9, "--versus=") == 0) {
+        options.versus = arg.substr(9);
+    } else if(arg.compare(0, 9, "--margin=") == 0) {
+        options.margin = atof(arg.substr(9).c_str());
+    } else if(arg.compare(0, 11, "--schedule=") == 0) {
+        options.schedule = arg.substr(11);
+    } else if(arg.compare(0, 12, "--quickpass=") == 0) {
+        options.quickPass = atof(arg.substr(12).c_str());
+    } else if(arg.compare(0, 9, "--giveup=") == 0) {
+        options.giveUpFactor = atof(arg.substr(9).c_str());
+    } else if(arg.compare(0, 11, "--rollouts=") == 0) {
+        options.rollouts = atoll(arg.substr(11).c_str());
+    } else if(arg.compare(0, 10, "--records=") == 0) {
+        options.recordPrefix = arg.substr(10);
+    } else if(arg.compare(0, 11, "--movetime=") == 0) {
+        options.moveTime = atoi(arg.substr(11).c_str());
+    } else if(arg.compare(0, 6, "--shm=") == 0) {
+        options.sharedMemoryName = arg.substr(6);
+    } else if(arg.compare(0, 14, "--distributed=") == 0) {
+        options.localProcesses = atoi(arg.substr(14).c_str());
+    } else if(arg.compare(0, 9, "--worker=") == 0) {
+        options.workerRank = atoi(arg.substr(9).c_str());
+    } else if(arg.compare(0, 8, "--peers=") == 0) {
+        /* host:port,host:port,... in rank order */
+        std::istringstream peers(arg.substr(8));
+        for(std::string peer; std::getline(peers, peer, ',');) {
+            const size_t colon = peer.rfind(':');
+            options.peers.push_back({ peer.substr(0, colon), static_cast<uint16_t>(colon == std::string::npos ? options.port : atoi(peer.substr(colon + 1).c_str())) });
+        }
+    } else if(arg.compare(0, 7, "--port=") == 0) {
+        options.port = atoi(arg.substr(7).c_str());
+    } else if(arg.compare(0, 10, "--timeout=") == 0) {
+        options.timeLimit = atoi(arg.substr(10).c_str());
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/* applies the options that only some choosers take */
+template <class Chooser>
+inline void configureChooser(Chooser&, const Options&) {}
+template <class State>
+inline void configureChooser(AStarChooser<State>& chooser, const Options& options) { chooser.setGiveUpFactor(options.giveUpFactor); }
+
+/* Plays the deals with the given seeds on a thread pool, starting them in that order, giving each game's
+ * records to `writer`, if set, and returns whether each was won.  Each worker has its own chooser, seeded from
+ * `seed` and allowed `moveTime` ms a move, and collects a game's records in its arena. */
+template <class Chooser>
+std::vector<uint8_t> runGames(const std::vector<unsigned>& deals, uint64_t seed, unsigned moveTime, RecordWriter* writer, const Options& options) {
+    typedef std::vector<SelfPlayRecord,astar::ArenaAllocator<SelfPlayRecord>> Records;
+    astar::ThreadPool pool(options.threads, options.pinThreads);
+    /* made by each worker when it starts its first game */
+    std::vector<std::unique_ptr<Chooser>> choosers(pool.size());
+    std::vector<uint8_t> won(deals.size());
+    std::atomic<size_t> gamesWon(0);
+    std::mutex progressMutex;
+    size_t gamesDone = 0;
+    const auto startTime = std::chrono::steady_clock::now();
+    for(size_t game=0; game<deals.size(); ++game) {
+        pool.submit([&, game](size_t worker) {
+                if(!choosers[worker]) {
+                    choosers[worker].reset(new Chooser(std::chrono::milliseconds(moveTime), astar::mix64(seed ^ (static_cast<uint64_t>(worker) << 32))));
+                    configureChooser(*choosers[worker], options);
+                }
+                astar::Arena& arena = pool.getArena(worker);
+                {
+                    Records records{astar::ArenaAllocator<SelfPlayRecord>(arena)};
+                    selfPlayGame(deals[game], *choosers[worker], records);
+                    if(writer) {
+                        writer->write(records.data(), records.size());
+                    }
+                    won[game] = !records.empty() && records.front().won;
+                    gamesWon += won[game];
+                }
+                arena.reset();
+                std::lock_guard<std::mutex> lock(progressMutex);
+                const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+                std::cout << "\x1b[2K\rGames " << ++gamesDone << "/" << deals.size() << ", Won " << gamesWon;
+                if(writer) {
+                    std::cout << ", Positions " << writer->getNumRecords() << " (" << static_cast<size_t>(writer->getNumRecords() / seconds * 3600) << "/hour)";
+                }
+                std::cout.flush();
+            });
+    }
+    pool.wait();
+    std::cout << std::endl;
+    for(size_t worker=0; worker<pool.size(); ++worker) {
+        const astar::ThreadPool::Statistics& statistics = pool.getStatistics(worker);
+        std::cout << "Thread " << worker;
+        if(statistics.cpu >= 0) {
+            std::cout << " (CPU " << statistics.cpu << ")";
+        }
+        std::cout << ": " << statistics.jobsRun << " games in " << std::chrono::duration<double>(statistics.busy).count() << "s" << std::endl;
+    }
+    return won;
+}
+
+/* Plays `numGames` games from consecutive seeds as options.schedule and options.quickPass say (the quick pass
+ * only in a batch, so that self-play records all come from the same player) and returns the number won.  Started
+ * in seed order, a few long games that happen to come last leave every other thread idle at the end.  Only the
+ * peeking A* engine at draw one, which HardnessPredictor's weights were fitted to, is started longest first;
+ * the others keep seed order. */
+template <class R, class Chooser>
+size_t scheduleGames(unsigned firstSeed, size_t numGames, RecordWriter* writer, const Options& options) {
+    static constexpr size_t DEALS_PER_JOB = 256;
+    const bool longestFirst = options.schedule == "longest" && std::is_same<Chooser, AStarChooser<BasicGameState<DrawOne>>>::value;
+    const bool quickPass = options.quickPass > 0 && !writer;
+    if(options.schedule == "longest" && !longestFirst) {
+        std::cout << "Deal lengths are only predicted for the peeking A* engine at draw one; starting games in seed order" << std::endl;
+    }
+    std::vector<typename HardnessPredictor<R>::Prediction> predictions(numGames);
+    if(longestFirst || quickPass) {
+        astar::ThreadPool pool(options.threads, options.pinThreads);
+        const HardnessPredictor<R> predictor;
+        for(size_t first=0; first<numGames; first += DEALS_PER_JOB) {
+            pool.submit([&, first](size_t) {
+                    for(size_t game=first; game<numGames && game<first+DEALS_PER_JOB; ++game) {
+                        predictions[game] = predictor.predict(Deck(firstSeed + game), firstSeed + game);
+                    }
+                });
+        }
+        pool.wait();
+    }
+    /* each deal's predicted length, and its seed */
+    std::vector<std::pair<double, unsigned>> deals;
+    std::vector<unsigned> trivial;
+    for(size_t game=0; game<numGames; ++game) {
+        if(quickPass && predictions[game].trivial) {
+            trivial.push_back(firstSeed + game);
+        } else {
+            deals.emplace_back(predictions[game].plies, firstSeed + game);
+        }
+    }
+    size_t won = 0;
+    if(!trivial.empty()) {
+        const unsigned moveTime = std::max(static_cast<unsigned>(options.quickPass * options.moveTime), 1u);
+        std::cout << "Quick pass over " << trivial.size() << " deals predicted trivial, at " << moveTime << "ms a move" << std::endl;
+        const std::vector<uint8_t> quickWon = runGames<Chooser>(trivial, astar::mix64(firstSeed), moveTime, nullptr, options);
+        for(size_t i=0; i<trivial.size(); ++i) {
+            if(quickWon[i]) {
+                ++won;
+            } else {
+                deals.emplace_back(0.0, trivial[i]);
+            }
+        }
+    }
+    if(longestFirst) {
+        std::stable_sort(deals.begin(), deals.end(), [](const std::pair<double, unsigned>& a, const std::pair<double, unsigned>& b) {
+                return a.first > b.first;
+            });
+    }
+    std::vector<unsigned> seeds;
+    for(const auto& deal : deals) {
+        seeds.push_back(deal.second);
+    }
+    for(uint8_t outcome : runGames<Chooser>(seeds, firstSeed, options.moveTime, writer, options)) {
+        won += outcome;
+    }
+    return won;
+}
+
+template <class R>
+size_t playGames(unsigned firstSeed, size_t numGames, RecordWriter* writer, const Options& options) {
+    if(options.engine == "expectimax") {
+        return scheduleGames<R, ExpectimaxChooser<R>>(firstSeed, numGames, writer, options);
+    } else if(options.engine == "subgoal") {
+        return scheduleGames<R, SubgoalChooser<R>>(firstSeed, numGames, writer, options);
+    } else if(options.honest) {
+        return scheduleGames<R, AStarChooser<BasicHonestState<R>>>(firstSeed, numGames, writer, options);
+    }
+    return scheduleGames<R, AStarChooser<BasicGameState<R>>>(firstSeed, numGames, writer, options);
+}
+
+template <class R>
+int selfPlay(unsigned firstSeed, const Options& options) {
+    RecordWriter writer(options.recordPrefix);
+    playGames<R>(firstSeed, options.selfPlayGames, &writer, options);
+    std::cout << "Wrote " << writer.getNumRecords() << " records to " << writer.getNumFiles() << " file(s) named " << options.recordPrefix << ".NNNNNN.bin" << std::endl;
+    return 0;
+}
+
+/* a function that plays the deal with the given seed to the end with a chooser of its own and returns whether it won */
+template <class Chooser>
+std::function<bool(unsigned)> makeChooserPlayer(const Options& options, uint64_t seed) {
+    const std::shared_ptr<Chooser> chooser = std::make_shared<Chooser>(std::chrono::milliseconds(options.moveTime), seed);
+    configureChooser(*chooser, options);
+    return [chooser](unsigned deal) {
+        std::vector<SelfPlayRecord> records;
+        selfPlayGame(deal, *chooser, records);
+        return !records.empty() && records.front().won;
+    };
+}
+
+template <class R>
+std::function<bool(unsigned)> makePlayer(const Options& options, uint64_t seed) {
+    if(options.engine == "expectimax") {
+        return makeChooserPlayer<ExpectimaxChooser<R>>(options, seed);
+    } else if(options.engine == "subgoal") {
+        return makeChooserPlayer<SubgoalChooser<R>>(options, seed);
+    } else if(options.honest) {
+        return makeChooserPlayer<AStarChooser<BasicHonestState<R>>>(options, seed);
+    }
+    return makeChooserPlayer<AStarChooser<BasicGameState<R>>>(options, seed);
+}
+
+/* Plays deals from consecutive seeds on a thread pool, each with every one of `configurations` in turn, and
+ * passes each deal's outcomes to `update` in seed order whatever order the games finish in, so that a
+ * stopping rule sees the same sequence it would playing one game at a time.  Stops when `update` returns
+ * true or after `maxGames` deals, and returns the number of deals passed to `update`. */
+template <class R>
+size_t runSequential(unsigned firstSeed, size_t maxGames, const std::vector<Options>& configurations, const Options& options, const std::function<bool(const std::vector<uint8_t>&)>& update) {
+    astar::ThreadPool pool(options.threads, options.pinThreads);
+    /* made by each worker when it starts its first deal */
+    std::vector<std::vector<std::function<bool(unsigned)>>> players(pool.size());
+    std::atomic<bool> settled(false);
+    std::mutex mutex;
+    /* the outcomes of deals that finished before an earlier one */
+    std::map<size_t, std::vector<uint8_t>> finished;
+    size_t nextDeal = 0;
+    for(size_t game=0; game<maxGames && !settled; ++game) {
+        pool.submit([&, game](size_t worker) {
+                if(settled) {
+                    return;
+                }
+                if(players[worker].empty()) {
+                    for(size_t c=0; c<configurations.size(); ++c) {
+                        players[worker].push_back(makePlayer<R>(configurations[c], astar::mix64(firstSeed ^ (static_cast<uint64_t>(worker) << 32) ^ (static_cast<uint64_t>(c) << 48))));
+                    }
+                }
+                std::vector<uint8_t> outcomes;
+                for(auto& player : players[worker]) {
+                    outcomes.push_back(player(firstSeed + game));
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                finished[game] = std::move(outcomes);
+                for(auto it = finished.begin(); it != finished.end() && it->first == nextDeal && !settled; it = finished.erase(it)) {
+                    ++nextDeal;
+                    settled = update(it->second);
+                }
+            });
+    }
+    pool.wait();
+    return nextDeal;
+}
+
+inline std::ostream& operator<<(std::ostream& stream, const astar::Interval& interval) {
+    return stream << std::fixed << std::setprecision(2) << 100.0 * interval.estimate << "% (95% CI " << 100.0 * interval.low << "% to " << 100.0 * interval.high << "%)";
+}
+
+/* plays deals until the win rate is known to within options.precision, or options.batchGames deals */
+template <class R>
+int estimateWinRate(unsigned firstSeed, size_t maxGames, const Options& options) {
+    size_t won = 0;
+    size_t played = 0;
+    runSequential<R>(firstSeed, maxGames, std::vector<Options>(1, options), options, [&](const std::vector<uint8_t>& outcomes) {
+            won += outcomes[0];
+            const astar::Interval interval = astar::wilsonInterval(won, ++played);
+            std::cout << "\x1b[2K\rGames " << played << ", Won " << won << ": " << interval;
+            std::cout.flush();
+            return interval.halfWidth() <= options.precision;
+        });
+    std::cout << std::endl << "Won " << won << " of " << played << " games: " << astar::wilsonInterval(won, played) << std::endl;
+    return 0;
+}
+
+/* Plays every deal with both configurations and looks only at the deals that exactly one of them won: if
+ * neither is better, each is as likely to be the one.  Two SPRTs run on those deals, one for whether A wins
+ * half of them or 0.5 + margin, and one the same for B; each stops for good once it decides, and the
+ * comparison stops when one finds its side better or both find neither is. */
+template <class R>
+int compareConfigurations(unsigned firstSeed, size_t maxGames, const Options& options) {
+    Options other = options;
+    std::istringstream overrides(options.versus);
+    for(std::string override; std::getline(overrides, override, ',');) {
+        if(!parseOption("--" + override, other)) {
+            std::cerr << "Unknown option in --versus: " << override << std::endl;
+            return 1;
+        }
+    }
+    if(other.engine != "astar" && other.engine != "expectimax" && other.engine != "subgoal") {
+        std::cerr << "Unknown engine in --versus: " << other.engine << std::endl;
+        return 1;
+    } else if(!(options.margin > 0 && options.margin < 0.5)) {
+        std::cerr << "The margin must be between 0 and 0.5" << std::endl;
+        return 1;
+    }
+    astar::Sprt sprts[2] = { astar::Sprt(0.5, 0.5 + options.margin), astar::Sprt(0.5, 0.5 + options.margin) };
+    size_t won[2] = { 0, 0 };
+    /* the deals that only A, or only B, won */
+    size_t split[2] = { 0, 0 };
+    size_t played = 0;
+    std::vector<Options> configurations;
+    configurations.push_back(options);
+    configurations.push_back(other);
+    runSequential<R>(firstSeed, maxGames, configurations, options, [&](const std::vector<uint8_t>& outcomes) {
+            won[0] += outcomes[0];
+            won[1] += outcomes[1];
+            ++played;
+            split[0] += outcomes[0] && !outcomes[1];
+            split[1] += outcomes[1] && !outcomes[0];
+            for(size_t i=0; i<2; ++i) {
+                if(outcomes[0] != outcomes[1] && sprts[i].getDecision() == astar::Sprt::CONTINUE) {
+                    sprts[i].add(outcomes[i]);
+                }
+            }
+            std::cout << "\x1b[2K\rGames " << played << ", A won " << won[0] << ", B won " << won[1] << ", LLRs " << std::fixed << std::setprecision(2) << sprts[0].getLogLikelihoodRatio() << " and " << sprts[1].getLogLikelihoodRatio() << " in (" << sprts[0].getLowerBound() << ", " << sprts[0].getUpperBound() << ")";
+            std::cout.flush();
+            return sprts[0].getDecision() == astar::Sprt::ACCEPT_P1 || sprts[1].getDecision() == astar::Sprt::ACCEPT_P1 || (sprts[0].getDecision() == astar::Sprt::ACCEPT_P0 && sprts[1].getDecision() == astar::Sprt::ACCEPT_P0);
+        });
+    std::cout << std::endl;
+    std::cout << "A (as given):          won " << won[0] << " of " << played << ": " << astar::wilsonInterval(won[0], played) << std::endl;
+    std::cout << "B (with " << options.versus << "): won " << won[1] << " of " << played << ": " << astar::wilsonInterval(won[1], played) << std::endl;
+    std::cout << "Of the " << split[0] + split[1] << " deals only one of them won, A won " << split[0] << " and B won " << split[1] << std::endl;
+    if(sprts[0].getDecision() == astar::Sprt::ACCEPT_P1) {
+        std::cout << "A is better" << std::endl;
+    } else if(sprts[1].getDecision() == astar::Sprt::ACCEPT_P1) {
+        std::cout << "B is better" << std::endl;
+    } else if(sprts[0].getDecision() == astar::Sprt::ACCEPT_P0 && sprts[1].getDecision() == astar::Sprt::ACCEPT_P0) {
+        std::cout << "Neither is better by the margin" << std::endl;
+    } else {
+        std::cout << "Undecided after " << played << " games" << std::endl;
+    }
+    return 0;
+}
+
+template <class R>
+int playBatch(unsigned firstSeed, const Options& options) {
+    /* with a stopping rule, the batch size is only a limit */
+    const size_t maxGames = options.batchGames > 0 ? options.batchGames : UINT_MAX;
+    if(!options.versus.empty()) {
+        return compareConfigurations<R>(firstSeed, maxGames, options);
+    } else if(options.precision > 0) {
+        return estimateWinRate<R>(firstSeed, maxGames, options);
+    }
+    const size_t won = playGames<R>(firstSeed, options.batchGames, nullptr, options);
+    std::cout << "Won " << won << " of " << options.batchGames << " games (" << std::fixed << std::setprecision(1) << 100.0 * won / options.batchGames << "%)" << std::endl;
+    return 0;
+}
+
+/* plays `options.rollouts` deals with RolloutPlayer's rules on a thread pool, in jobs of consecutive seeds that
+ * each stream through a RolloutBatch */
+template <class R>
+int playRollouts(unsigned firstSeed, const Options& options) {
+    static constexpr size_t GAMES_PER_JOB = 1 << 12;
+    astar::ThreadPool pool(options.threads, options.pinThreads);
+    std::atomic<size_t> gamesWon(0);
+    std::atomic<size_t> foundationCards(0);
+    const auto startTime = std::chrono::steady_clock::now();
+    for(size_t first=0; first<options.rollouts; first += GAMES_PER_JOB) {
+        pool.submit([&, first](size_t) {
+                typedef RolloutBatch<64, R> Batch;
+                Batch batch;
+                size_t won = 0;
+                size_t cards = 0;
+                size_t game = first;
+                const size_t last = std::min(first + GAMES_PER_JOB, options.rollouts);
+                batch.run([&](size_t lane) {
+                        if(game == last) {
+                            return false;
+                        }
+                        batch.reset(lane, Deck(firstSeed + game++));
+                        return true;
+                    }, [&](size_t, const typename Batch::Result& result) {
+                        won += result.won;
+                        cards += result.foundationCards;
+                    });
+                gamesWon += won;
+                foundationCards += cards;
+            });
+    }
+    pool.wait();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    std::cout << "Won " << gamesWon << " of " << options.rollouts << " games (" << std::fixed << std::setprecision(2) << 100.0 * gamesWon / options.rollouts << "%), " << static_cast<double>(foundationCards) / options.rollouts << " cards to the foundations per game, " << static_cast<size_t>(options.rollouts / seconds) << " games/s" << std::endl;
+    return 0;
+}
+
+/* serves a batch of games to another process over shared memory until it sets the stop flag */
+template <class R>
+int serveSharedMemory(unsigned firstSeed, const Options& options) {
+    typedef SharedBatch<16, R> Shared;
+    const std::string name = "/" + options.sharedMemoryName;
+    const int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+    if(fd < 0 || ftruncate(fd, sizeof(Shared)) != 0) {
+        std::cerr << "Unable to create shared memory " << name << std::endl;
+        return 1;
+    }
+    void* memory = mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(memory == MAP_FAILED) {
+        std::cerr << "Unable to map shared memory " << name << std::endl;
+        shm_unlink(name.c_str());
+        return 1;
+    }
+    Shared* shared = new(memory) Shared();
+    std::cout << "Serving " << Shared::Batch::LANES << " games in " << name << " (" << sizeof(Shared) << " bytes)" << std::endl;
+
+    typename Shared::Batch batch;
+    unsigned seeds[Shared::Batch::LANES];
+    unsigned nextSeed = firstSeed;
+    for(size_t lane=0; lane<Shared::Batch::LANES; ++lane) {
+        seeds[lane] = nextSeed++;
+    }
+    batch.reset(seeds);
+    typename Shared::Observation* slot = shared->observations.claim();
+    memset(slot->rewards, 0, sizeof(slot->rewards));
+    memset(slot->done, 0, sizeof(slot->done));
+    for(uint64_t step=0;; ++step) {
+        for(size_t lane=0; lane<Shared::Batch::LANES; ++lane) {
+            if(batch.isDone(lane)) {
+                batch.reset(lane, nextSeed++);
+            }
+        }
+        batch.observe(slot->observations);
+        batch.legalMoves(slot->legalMoves);
+        slot->step = step;
+        shared->observations.publish();
+        if(step == 0) {
+            shared->ready();
+        }
+        const typename Shared::Action* action = nullptr;
+        while(!(action = shared->actions.peek()) && !shared->stop.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        while(!(slot = shared->observations.claim()) && !shared->stop.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        if(!action || !slot) {
+            std::cout << "Stopped after " << step << " steps" << std::endl;
+            break;
+        }
+        batch.step(action->actions, slot->rewards, slot->done);
+        shared->actions.release();
+    }
+    munmap(memory, sizeof(Shared));
+    shm_unlink(name.c_str());
+    return 0;
+}
+
+/* solves the deal as process `rank` of a distributed search over `peers` */
+template <class R>
+int searchDistributed(const Deck& deck, const std::vector<astar::Peer>& peers, size_t rank, const Options& options) {
+    typedef BasicGameState<R> State;
+    typedef astar::DistributedSearch<State,unsigned(*)(const State&)> SearchType;
+    const State game(deck);
+    try {
+        SearchType search(peers, rank, &naiveHeuristic<R>);
+        const typename SearchType::Result result = search.solve(game, std::chrono::seconds(options.timeLimit), [rank, &search](const typename SearchType::Result& result) {
+                if(rank == 0) {
+                    std::cout << "\x1b[2K\rSearching: Process 0 Expanded " << result.statesExpanded << ", Closed " << search.getNumClosed() << ", Batches Sent " << result.batchesSent;
+                    std::cout.flush();
+                }
+            });
+        if(rank == 0) {
+            std::cout << "\x1b[2K\r";
+            if(result.solved) {
+                std::cout << "Game #" << deck.getSeed() << " can be won in " << result.pathLength << " moves, starting with:" << std::endl << std::endl << game.applyMove(Move::unpack(result.initialMove)) << std::endl;
+            } else if(result.exhausted) {
+                std::cout << "Game #" << deck.getSeed() << " cannot be won" << std::endl;
+            } else {
+                std::cout << "Game #" << deck.getSeed() << ": no solution found in time" << std::endl;
+            }
+        }
+        std::cout << "Process " << rank << ": Expanded " << result.statesExpanded << ", Closed " << search.getNumClosed() << ", Batches Sent " << result.batchesSent << std::endl;
+    } catch(const std::runtime_error& error) {
+        std::cerr << "Process " << rank << ": " << error.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+/* runs a distributed search with `processes` processes on this machine, one per port from options.port */
+template <class R>
+int searchLocally(const Deck& deck, size_t processes, const Options& options) {
+    std::vector<astar::Peer> peers;
+    for(size_t i=0; i<processes; ++i) {
+        peers.push_back({ "127.0.0.1", static_cast<uint16_t>(options.port + i) });
+    }
+    std::cout.flush();
+    std::vector<pid_t> children;
+    for(size_t rank=1; rank<processes; ++rank) {
+        const pid_t pid = fork();
+        if(pid == 0) {
+            _exit(searchDistributed<R>(deck, peers, rank, options));
+        } else if(pid < 0) {
+            std::cerr << "Unable to start process " << rank << std::endl;
+        } else {
+            children.push_back(pid);
+        }
+    }
+    int ret = searchDistributed<R>(deck, peers, 0, options);
+    for(pid_t child : children) {
+        int status = 0;
+        waitpid(child, &status, 0);
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            ret = 1;
+        }
+    }
+    return ret;
+}
+
+template <class R>
+inline int play(const Deck& deck, const Options& options) {
+    if(options.engine != "astar" && options.engine != "expectimax" && options.engine != "subgoal") {
+        std::cerr << "Unknown engine: " << options.engine << " (expected one of: astar, expectimax, subgoal)" << std::endl;
+        return 1;
+    } else if(options.schedule != "longest" && options.schedule != "fifo") {
+        std::cerr << "Unknown schedule: " << options.schedule << " (expected one of: longest, fifo)" << std::endl;
+        return 1;
+    } else if(options.localProcesses > 0) {
+        return searchLocally<R>(deck, options.localProcesses, options);
+    } else if(options.workerRank >= 0) {
+        if(static_cast<size_t>(options.workerRank) >= options.peers.size()) {
+            std::cerr << "Worker " << options.workerRank << " is not in the list of " << options.peers.size() << " peers" << std::endl;
+            return 1;
+        }
+        return searchDistributed<R>(deck, options.peers, options.workerRank, options);
+    } else if(!options.sharedMemoryName.empty()) {
+        return serveSharedMemory<R>(deck.getSeed(), options);
+    } else if(options.selfPlayGames > 0) {
+        return selfPlay<R>(deck.getSeed(), options);
+    } else if(options.batchGames > 0 || options.precision > 0 || !options.versus.empty()) {
+        return playBatch<R>(deck.getSeed(), options);
+    } else if(options.rollouts > 0) {
+        return playRollouts<R>(deck.getSeed(), options);
+    } else if(options.engine == "expectimax") {
+        return playExpectimax<R>(deck);
+    } else if(options.engine == "subgoal") {
+        return playSubgoal<R>(deck);
+    }
+    return options.honest ? play<BasicHonestState<R>>(deck, options.historyType, options.giveUpFactor) : play<BasicGameState<R>>(deck, options.historyType, options.giveUpFactor);
+}
+
+int main(int argc, char** argv) {
+    Deck deck;
+    Options options = { "astar", "exact", false, 0, std::max<size_t>(std::thread::hardware_concurrency(), 1), false, "selfplay", 10, "", 0, 0.0, "", 0.1, "longest", 0.0, 1.0, 0, 0, -1, std::vector<astar::Peer>(), 7400, 0 };
+    unsigned draw = 1;
+    unsigned passes = 0;
+    for(int i=1; i<argc; ++i) {
+        std::string arg(argv[i]);
+        if(arg.compare(0, 7, "--draw=") == 0) {
+            draw = atoi(arg.substr(7).c_str());
+        } else if(arg.compare(0, 9, "--passes=") == 0) {
+            passes = atoi(arg.substr(9).c_str());
+        } else if(!parseOption(arg, options)) {
+            unsigned seed = atoll(argv[i]);
+            deck = Deck(seed);
+        }
+    }
+    /* each variant is a separate instantiation of everything, so only the common ones are built in */
+    if(draw == DrawOne::DRAW && passes == DrawOne::PASSES) {
+        return play<DrawOne>(deck, options);
+    } else if(draw == DrawThree::DRAW && passes == DrawThree::PASSES) {
+        return play<DrawThree>(deck, options);
+    } else if(draw == DrawOneSinglePass::DRAW && passes == DrawOneSinglePass::PASSES) {
+        return play<DrawOneSinglePass>(deck, options);
+    } else if(draw == DrawThreeThreePasses::DRAW && passes == DrawThreeThreePasses::PASSES) {
+        return play<DrawThreeThreePasses>(deck, options);
+    }
+    std::cerr << "Unsupported variant: draw " << draw << " with " << passes << " passes (expected draw 1 or 3 with unlimited passes, draw 1 with one pass, or draw 3 with three passes)" << std::endl;
+    return 1;
+}
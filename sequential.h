@@ -0,0 +1,77 @@
+#ifndef ASTAR_SEQUENTIAL
+#define ASTAR_SEQUENTIAL
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+namespace astar {
+
+/* the z value of a two-sided 95% confidence interval */
+constexpr double Z_95 = 1.959963984540054;
+
+struct Interval {
+    double estimate;
+    double low;
+    double high;
+    inline double halfWidth() const { return (high - low) / 2; }
+};
+
+/* The Wilson score interval for a success probability after `successes` of `trials`.  Unlike the usual
+ * estimate plus or minus z standard errors, it stays inside [0, 1] and is not degenerate when there have
+ * been no successes (or no failures), which is common for hard variants. */
+inline Interval wilsonInterval(size_t successes, size_t trials, double z = Z_95) {
+    if(trials == 0) {
+        return { 0.0, 0.0, 1.0 };
+    }
+    const double n = static_cast<double>(trials);
+    const double p = successes / n;
+    const double z2 = z * z;
+    const double center = (p + z2 / (2 * n)) / (1 + z2 / n);
+    const double margin = z / (1 + z2 / n) * std::sqrt(p * (1 - p) / n + z2 / (4 * n * n));
+    return { p, std::max(0.0, center - margin), std::min(1.0, center + margin) };
+}
+
+/* Wald's sequential probability ratio test between two success probabilities p0 < p1 for a series of
+ * Bernoulli trials: the log-likelihood ratio of p1 to p0 is updated after every trial, and the test stops as
+ * soon as it crosses a bound set by the error rates, accepting p0 (with probability at most `beta` of doing
+ * so if p1 is true) or p1 (at most `alpha` if p0 is).  On average it needs far fewer trials than a test of a
+ * fixed size with the same error rates, and it ends with probability one whatever the true probability. */
+class Sprt {
+public:
+    enum Decision {
+        CONTINUE,
+        ACCEPT_P0,
+        ACCEPT_P1
+    };
+private:
+    double successStep;
+    double failureStep;
+    double lowerBound;
+    double upperBound;
+    double llr;
+    size_t successes;
+    size_t trials;
+public:
+    Sprt(double p0, double p1, double alpha = 0.05, double beta = 0.05) : successStep(std::log(p1 / p0)), failureStep(std::log((1 - p1) / (1 - p0))), lowerBound(std::log(beta / (1 - alpha))), upperBound(std::log((1 - beta) / alpha)), llr(0.0), successes(0), trials(0) {
+        assert(0 < p0 && p0 < p1 && p1 < 1);
+    }
+    inline void add(bool success) {
+        llr += success ? successStep : failureStep;
+        successes += success;
+        ++trials;
+    }
+    inline Decision getDecision() const {
+        return llr >= upperBound ? ACCEPT_P1 : llr <= lowerBound ? ACCEPT_P0 : CONTINUE;
+    }
+    inline double getLogLikelihoodRatio() const { return llr; }
+    inline double getLowerBound() const { return lowerBound; }
+    inline double getUpperBound() const { return upperBound; }
+    inline size_t getSuccesses() const { return successes; }
+    inline size_t getTrials() const { return trials; }
+};
+
+}
+
+#endif /* #ifndef ASTAR_SEQUENTIAL */
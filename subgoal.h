@@ -0,0 +1,126 @@
+#ifndef ASTAR_SUBGOAL
+#define ASTAR_SUBGOAL
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+#include <unordered_set>
+#include <algorithm>
+#include <utility>
+#include <chrono>
+
+#include "history.h"
+
+namespace astar {
+
+/* Plans only as far as the next chance event.  In a game where some moves reveal hidden information (T and
+ * Model are as for Expectimax), nothing changes what the player knows until such a move is made, so the
+ * positions worth choosing between are the "reveal frontier": the chance states one move past the
+ * positions reachable without revealing anything.  A breadth-first search enumerates those positions,
+ * merging any that look the same, and each frontier state is ranked by the mean evaluation of `samples`
+ * of its outcomes.  A won position beats every frontier state, and if there is no frontier at all the
+ * best-evaluated reachable position, if it improves on the root, is the goal instead. */
+template <class T, class Model, class Rng>
+class SubgoalPlanner {
+public:
+    typedef decltype(std::declval<const T&>().getLastMove()) MoveType;
+    struct Plan {
+        /* the moves from the root to the goal; empty if there is nothing worth doing */
+        std::vector<MoveType> moves;
+        /* the goal's estimated value, and how many positions and frontier states were looked at */
+        double value;
+        size_t statesExpanded;
+        size_t frontierSize;
+        /* whether the last move reveals something, so that the plan ends at a chance event */
+        bool reveals;
+    };
+private:
+    const Model& model;
+    Rng& rng;
+    size_t samples;
+    size_t maxStates;
+    struct Node {
+        T state;
+        size_t parent;
+        Node(const T& state, size_t parent) : state(state), parent(parent) {}
+    };
+    static std::vector<MoveType> pathTo(const std::vector<Node>& nodes, size_t index, const T* last) {
+        std::vector<MoveType> moves;
+        if(last) {
+            moves.push_back(last->getLastMove());
+        }
+        for(; nodes[index].parent != NO_PARENT; index = nodes[index].parent) {
+            moves.push_back(nodes[index].state.getLastMove());
+        }
+        std::reverse(moves.begin(), moves.end());
+        return moves;
+    }
+public:
+    /* each frontier state is ranked from `samples` outcomes, and at most `maxStates` positions are expanded */
+    SubgoalPlanner(const Model& model, Rng& rng, size_t samples = 16, size_t maxStates = 1 << 12) : model(model), rng(rng), samples(samples), maxStates(maxStates) {}
+    /* Positions in `history` (e.g., earlier positions of the game) are never passed through.  The search also
+     * stops expanding positions at `deadline`, if one is given, and plans with what it has found by then. */
+    Plan plan(const T& root, const std::unordered_set<T>& history, std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()) const {
+        const bool timed = deadline != std::chrono::steady_clock::time_point::max();
+        Plan best = { std::vector<MoveType>(), model.evaluate(root), 0, 0, false };
+        std::vector<Node> nodes;
+        std::unordered_set<T> visited;
+        std::unordered_set<T> frontier;
+        std::vector<T> outcomes;
+        size_t bestReachable = 0;
+        double bestReachableValue = best.value;
+        nodes.emplace_back(root, NO_PARENT);
+        visited.insert(root);
+        for(size_t i=0; i<nodes.size() && best.statesExpanded < maxStates && !(timed && i > 0 && std::chrono::steady_clock::now() >= deadline); ++i) {
+            ++best.statesExpanded;
+            /* copied, since emplace_back below may move the nodes */
+            const T state = nodes[i].state;
+            for(const T& child : state.successors()) {
+                if(history.count(child)) {
+                    continue;
+                } else if(child.isPending()) {
+                    if(!frontier.insert(child).second) {
+                        continue;
+                    }
+                    outcomes.clear();
+                    model.sample(state, child, samples, rng, outcomes);
+                    double sum = 0.0;
+                    for(const T& outcome : outcomes) {
+                        sum += outcome.isWin() ? 1.0 : model.evaluate(outcome);
+                    }
+                    const double value = outcomes.empty() ? 0.0 : sum / outcomes.size();
+                    /* breadth first, so among equals the first found is the closest */
+                    if(!best.reveals || value > best.value) {
+                        best.moves = pathTo(nodes, i, &child);
+                        best.value = value;
+                        best.reveals = true;
+                    }
+                } else if(visited.insert(child).second) {
+                    nodes.emplace_back(child, i);
+                    if(child.isWin()) {
+                        best.moves = pathTo(nodes, nodes.size() - 1, nullptr);
+                        best.value = 1.0;
+                        best.reveals = false;
+                        best.frontierSize = frontier.size();
+                        return best;
+                    }
+                    const double value = model.evaluate(child);
+                    if(value > bestReachableValue) {
+                        bestReachable = nodes.size() - 1;
+                        bestReachableValue = value;
+                    }
+                }
+            }
+        }
+        best.frontierSize = frontier.size();
+        if(!best.reveals && bestReachable != 0) {
+            best.moves = pathTo(nodes, bestReachable, nullptr);
+            best.value = bestReachableValue;
+        }
+        return best;
+    }
+};
+
+}
+
+#endif /* #ifndef ASTAR_SUBGOAL */
@@ -0,0 +1,351 @@
+#ifndef ASTAR_THREADPOOL
+#define ASTAR_THREADPOOL
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <new>
+#include <stdexcept>
+#include <algorithm>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace astar {
+
+constexpr size_t CACHE_LINE = 64;
+
+/* Bounded lock-free queue for any number of producers and consumers (Dmitry Vyukov's).  Each cell carries a
+ * sequence number saying whose turn it is, so a push or pop is one compare-and-swap on its end of the queue.
+ * The two ends are kept on separate cache lines so that producers and consumers do not share one. */
+template <class T>
+class MpmcQueue {
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+    Cell* cells;
+    size_t mask;
+    char pad0[CACHE_LINE];
+    std::atomic<size_t> enqueuePos;
+    char pad1[CACHE_LINE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> dequeuePos;
+    char pad2[CACHE_LINE - sizeof(std::atomic<size_t>)];
+public:
+    /* `capacity` must be a power of two */
+    explicit MpmcQueue(size_t capacity) : cells(new Cell[capacity]), mask(capacity - 1), enqueuePos(0), dequeuePos(0) {
+        assert(capacity >= 2 && (capacity & (capacity - 1)) == 0);
+        for(size_t i=0; i<capacity; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    MpmcQueue(const MpmcQueue&) = delete;
+    ~MpmcQueue() {
+        delete [] cells;
+    }
+    /* returns false, leaving `value` alone, if the queue is full */
+    bool tryPush(T& value) {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        for(;;) {
+            Cell& cell = cells[pos & mask];
+            const intptr_t difference = static_cast<intptr_t>(cell.sequence.load(std::memory_order_acquire)) - static_cast<intptr_t>(pos);
+            if(difference == 0) {
+                if(enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.data = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if(difference < 0) {
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    /* returns false if the queue is empty */
+    bool tryPop(T& value) {
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        for(;;) {
+            Cell& cell = cells[pos & mask];
+            const intptr_t difference = static_cast<intptr_t>(cell.sequence.load(std::memory_order_acquire)) - static_cast<intptr_t>(pos + 1);
+            if(difference == 0) {
+                if(dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.data);
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if(difference < 0) {
+                return false;
+            } else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+/* A bump allocator for one thread.  Memory comes from blocks of `blockSize` bytes (or bigger, for big
+ * requests), nothing is freed individually, and reset() gives every block back at once to the arena's own
+ * free list, to be reused before asking malloc for more.  Used from only one thread, an arena never contends
+ * with other threads for the allocator, and its memory stays near the core that uses it. */
+class Arena {
+private:
+    struct Block {
+        Block* next;
+        size_t size;
+    };
+    size_t blockSize;
+    Block* used;
+    Block* spare;
+    char* cursor;
+    char* end;
+    size_t bytesAllocated;
+    static char* begin(Block* block) {
+        return reinterpret_cast<char*>(block) + sizeof(Block);
+    }
+    void grow(size_t bytes) {
+        Block* block = spare;
+        if(block && block->size >= bytes) {
+            spare = block->next;
+        } else {
+            const size_t size = std::max(blockSize, bytes);
+            block = static_cast<Block*>(malloc(sizeof(Block) + size));
+            if(!block) {
+                throw std::bad_alloc();
+            }
+            block->size = size;
+        }
+        block->next = used;
+        used = block;
+        cursor = begin(block);
+        end = cursor + block->size;
+    }
+    static void release(Block* block) {
+        while(block) {
+            Block* next = block->next;
+            free(block);
+            block = next;
+        }
+    }
+public:
+    explicit Arena(size_t blockSize = 1 << 16) : blockSize(blockSize), used(nullptr), spare(nullptr), cursor(nullptr), end(nullptr), bytesAllocated(0) {}
+    Arena(const Arena&) = delete;
+    ~Arena() {
+        release(used);
+        release(spare);
+    }
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+        uintptr_t address = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+        if(!cursor || address + bytes > reinterpret_cast<uintptr_t>(end)) {
+            grow(bytes + alignment);
+            address = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+        }
+        cursor = reinterpret_cast<char*>(address + bytes);
+        bytesAllocated += bytes;
+        return reinterpret_cast<void*>(address);
+    }
+    /* everything allocated so far becomes invalid */
+    void reset() {
+        while(used) {
+            Block* next = used->next;
+            used->next = spare;
+            spare = used;
+            used = next;
+        }
+        cursor = end = nullptr;
+    }
+    /* in total, since the arena was made */
+    inline size_t getBytesAllocated() const { return bytesAllocated; }
+};
+
+/* lets standard containers allocate from an Arena; deallocation does nothing until the arena is reset */
+template <class T>
+class ArenaAllocator {
+private:
+    template <class U> friend class ArenaAllocator;
+    Arena* arena;
+public:
+    typedef T value_type;
+    explicit ArenaAllocator(Arena& arena) : arena(&arena) {}
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+    inline T* allocate(size_t n) {
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+    inline void deallocate(T*, size_t) {}
+    template <class U>
+    inline bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <class U>
+    inline bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+/* A fixed set of worker threads running jobs from an MpmcQueue.  Each job is told the index of the worker
+ * running it, so it can keep per-worker state without locks; each worker also has its own Arena and
+ * statistics, on cache lines of their own.  With `pin`, worker i is bound to the i-th CPU this process may
+ * run on (modulo their number).  Idle workers spin briefly and then sleep until a job is submitted. */
+class ThreadPool {
+public:
+    typedef std::function<void(size_t worker)> Job;
+    static constexpr size_t NO_WORKER = static_cast<size_t>(-1);
+    struct Statistics {
+        size_t jobsRun;
+        std::chrono::steady_clock::duration busy;
+        /* the CPU the worker was pinned to, or -1 */
+        int cpu;
+    };
+private:
+    struct alignas(CACHE_LINE) Worker {
+        Statistics statistics;
+        Arena arena;
+        std::thread thread;
+        Worker() : statistics{ 0, std::chrono::steady_clock::duration::zero(), -1 } {}
+    };
+    size_t numWorkers;
+    /* allocated by hand, since operator new does not honor alignas before C++17 */
+    Worker* workers;
+    MpmcQueue<Job> queue;
+    /* jobs submitted but not yet popped, and not yet finished */
+    std::atomic<size_t> queued;
+    std::atomic<size_t> pending;
+    std::atomic<size_t> sleeping;
+    std::atomic<bool> stopping;
+    std::mutex wakeMutex;
+    std::condition_variable wakeCondition;
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    static size_t& currentIndex() {
+        static thread_local size_t index = NO_WORKER;
+        return index;
+    }
+    static std::vector<int> allowedCpus() {
+        std::vector<int> cpus;
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if(sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for(int cpu=0; cpu<CPU_SETSIZE; ++cpu) {
+                if(CPU_ISSET(cpu, &set)) {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+#endif
+        return cpus;
+    }
+    static bool pinTo(int cpu) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        (void)cpu;
+        return false;
+#endif
+    }
+    void run(size_t index, int cpu) {
+        currentIndex() = index;
+        Worker& worker = workers[index];
+        if(cpu >= 0 && pinTo(cpu)) {
+            worker.statistics.cpu = cpu;
+        }
+        Job job;
+        for(unsigned spins = 0;;) {
+            if(queue.tryPop(job)) {
+                --queued;
+                spins = 0;
+                const auto startTime = std::chrono::steady_clock::now();
+                job(index);
+                job = nullptr;
+                worker.statistics.busy += std::chrono::steady_clock::now() - startTime;
+                ++worker.statistics.jobsRun;
+                if(--pending == 0) {
+                    std::lock_guard<std::mutex> lock(doneMutex);
+                    doneCondition.notify_all();
+                }
+            } else if(queued > 0 || ++spins < 64) {
+                /* a job may be on its way into the queue */
+                std::this_thread::yield();
+            } else if(stopping) {
+                return;
+            } else {
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                ++sleeping;
+                wakeCondition.wait(lock, [this]() { return queued > 0 || stopping; });
+                --sleeping;
+                spins = 0;
+            }
+        }
+    }
+public:
+    explicit ThreadPool(size_t numThreads = std::thread::hardware_concurrency(), bool pin = false, size_t queueCapacity = 1 << 12) : numWorkers(std::max<size_t>(numThreads, 1)), workers(nullptr), queue(queueCapacity), queued(0), pending(0), sleeping(0), stopping(false) {
+        void* memory = nullptr;
+        if(posix_memalign(&memory, alignof(Worker), sizeof(Worker) * numWorkers) != 0) {
+            throw std::bad_alloc();
+        }
+        workers = static_cast<Worker*>(memory);
+        for(size_t i=0; i<numWorkers; ++i) {
+            new (&workers[i]) Worker();
+        }
+        const std::vector<int> cpus = pin ? allowedCpus() : std::vector<int>();
+        for(size_t i=0; i<numWorkers; ++i) {
+            const int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+            workers[i].thread = std::thread([this, i, cpu]() { run(i, cpu); });
+        }
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    /* finishes every job already submitted */
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            stopping = true;
+        }
+        wakeCondition.notify_all();
+        for(size_t i=0; i<numWorkers; ++i) {
+            workers[i].thread.join();
+            workers[i].~Worker();
+        }
+        free(workers);
+    }
+    inline size_t size() const { return numWorkers; }
+    /* the index of the pool worker calling this, or NO_WORKER */
+    static inline size_t currentWorker() { return currentIndex(); }
+    /* waits for room if the queue is full */
+    void submit(Job job) {
+        ++pending;
+        ++queued;
+        for(unsigned spins = 0; !queue.tryPush(job); ++spins) {
+            /* a full queue will not drain soon if jobs are long, so stop competing with the workers for a core */
+            if(spins < 64) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+        if(sleeping > 0) {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            wakeCondition.notify_one();
+        }
+    }
+    /* blocks until every job submitted so far has finished */
+    void wait() {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneCondition.wait(lock, [this]() { return pending == 0; });
+    }
+    /* only for use by the worker itself, from inside a job */
+    inline Arena& getArena(size_t worker) { return workers[worker].arena; }
+    /* only meaningful once the worker's jobs have finished, e.g. after wait() */
+    inline const Statistics& getStatistics(size_t worker) const { return workers[worker].statistics; }
+};
+
+}
+
+#endif /* #ifndef ASTAR_THREADPOOL */